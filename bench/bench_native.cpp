@@ -0,0 +1,272 @@
+// Host-side benchmark of the firmware hot paths: TFmini parser, yaw
+// integrator, tilt filter and telemetry encoders/formatters. Built by [env:native]:
+//
+//   pio run -e native && .pio/build/native/program [tfmini_capture.bin]
+//
+// A capture file, if given, is raw bytes from the TFmini UART and is fed to
+// the parser after the synthetic streams. Exits non-zero if the parser loses
+// or miscounts frames in the synthetic streams or anything allocates, so it
+// also works as a regression check.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <new>
+#include <vector>
+
+#include "telemetry.h"
+#include "tfmini.h"
+#include "tilt.h"
+#include "yaw.h"
+
+// None of the firmware modules should touch the heap; count to be sure.
+// The replacements all sit on malloc/free and stay out of line, so GCC
+// doesn't inline one side of a new/delete pair into the malloc/free of the
+// other and warn about a mismatch (-Wmismatched-new-delete).
+static unsigned long allocations = 0;
+
+__attribute__((noinline)) void *operator new(size_t size) {
+  allocations++;
+  void *p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+__attribute__((noinline)) void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+  free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p) noexcept {
+  free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p, size_t) noexcept {
+  free(p);
+}
+
+// Reports a failed check on stderr and returns ok
+static bool check(bool ok, const char *bench, const char *what) {
+  if (!ok) fprintf(stderr, "FAIL %s: %s\n", bench, what);
+  return ok;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double nsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// Deterministic so runs are comparable
+static uint32_t rngState = 12345;
+
+static uint32_t rng() {
+  rngState = rngState * 1103515245 + 12345;
+  return rngState >> 8;
+}
+
+static void appendFrame(std::vector<uint8_t> &out, uint16_t dist, uint16_t strength, uint16_t temp) {
+  uint8_t frame[TFMINI_FRAME_LEN] = {
+    TFMINI_HEADER, TFMINI_HEADER,
+    (uint8_t)dist, (uint8_t)(dist >> 8),
+    (uint8_t)strength, (uint8_t)(strength >> 8),
+    (uint8_t)temp, (uint8_t)(temp >> 8), 0,
+  };
+  for (uint8_t i = 0; i < TFMINI_FRAME_LEN - 1; i++) frame[8] += frame[i];
+  out.insert(out.end(), frame, frame + TFMINI_FRAME_LEN);
+}
+
+// frames valid frames; corruptPerMille of them get one byte flipped and
+// responsePerMille are followed by a frame-rate command response.
+static std::vector<uint8_t> tfminiStream(uint32_t frames, uint32_t corruptPerMille,
+                                         uint32_t responsePerMille, uint32_t &corrupted) {
+  std::vector<uint8_t> out;
+  out.reserve(frames * TFMINI_FRAME_LEN + frames / 10);
+  corrupted = 0;
+  for (uint32_t i = 0; i < frames; i++) {
+    appendFrame(out, 10 + rng() % 1200, 100 + rng() % 3000, 2560 + 8 * 40);
+    if (rng() % 1000 < corruptPerMille) {
+      out[out.size() - 1 - rng() % TFMINI_FRAME_LEN] ^= 1 << (rng() % 8);
+      corrupted++;
+    }
+    if (rng() % 1000 < responsePerMille) {
+      uint8_t cmd[TFMINI_CMD_MAX];
+      uint8_t len = tfminiFrameRateCommand(cmd, 100);
+      out.insert(out.end(), cmd, cmd + len);
+    }
+  }
+  return out;
+}
+
+// expected is 0 for a capture, whose frame count isn't known
+static bool benchParser(const char *name, const std::vector<uint8_t> &stream, uint32_t expected,
+                        uint32_t corrupted) {
+  TFminiParser parser;
+  tfminiReset(parser);
+  uint32_t checksum = 0;
+  unsigned long allocsBefore = allocations;
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < stream.size(); i++) {
+    if (tfminiFeed(parser, stream[i])) checksum += tfminiDistance(parser);
+  }
+  double ns = nsSince(start);
+  printf("%-22s %8.1f ns/frame %6.2f ns/byte  ok %lu/%lu  bad %lu (corrupted %lu) "
+         "resyncs %lu responses %lu  allocs %lu  [%lu]\n",
+         name, parser.framesOk ? ns / parser.framesOk : 0.0, ns / stream.size(),
+         (unsigned long)parser.framesOk, (unsigned long)expected,
+         (unsigned long)parser.checksumErrors, (unsigned long)corrupted,
+         (unsigned long)parser.resyncs, (unsigned long)parser.responses,
+         allocations - allocsBefore, (unsigned long)checksum);
+
+  // A corrupted frame is never accepted and costs at most the frame after it
+  // as well; a clean stream gets through without errors or resyncs.
+  bool ok = check(allocations == allocsBefore, name, "allocated");
+  if (expected) {
+    ok &= check(parser.framesOk <= expected && expected - parser.framesOk <= corrupted, name,
+                "frames lost or accepted");
+    ok &= check(parser.checksumErrors <= corrupted, name, "checksum errors on good frames");
+    ok &= check(parser.resyncs <= corrupted, name, "resyncs on good frames");
+  }
+  return ok;
+}
+
+static bool benchYaw(uint32_t updates) {
+  YawIntegrator yaw;
+  yawReset(yaw);
+  yaw.biasQ4 = 37;
+  std::vector<int16_t> raw(1024);
+  for (size_t i = 0; i < raw.size(); i++) raw[i] = (int16_t)(rng() % 4001) - 2000;
+  uint16_t sum = 0;
+  unsigned long allocsBefore = allocations;
+  Clock::time_point start = Clock::now();
+  for (uint32_t i = 0; i < updates; i++) {
+    yawUpdate(yaw, raw[i & 1023], 1000 + (i & 63));
+    sum += yawCentideg(yaw);
+  }
+  double ns = nsSince(start);
+  printf("%-22s %8.1f ns/update  allocs %lu  [%u]\n", "yaw integrator", ns / updates,
+         allocations - allocsBefore, sum);
+  return check(allocations == allocsBefore, "yaw integrator", "allocated");
+}
+
+static bool benchTilt(uint32_t updates) {
+  TiltFilter filter;
+  const int16_t level[3] = {0, 0, 4096};
+  tiltFilterInit(filter, level, 3, -5);
+  std::vector<int16_t> axes(6 * 1024);
+  for (size_t i = 0; i < axes.size(); i += 6) {
+    axes[i] = (int16_t)(rng() % 801) - 400;
+    axes[i + 1] = (int16_t)(rng() % 801) - 400;
+    axes[i + 2] = 4096 + (int16_t)(rng() % 201) - 100;
+    axes[i + 3] = (int16_t)(rng() % 401) - 200;
+    axes[i + 4] = (int16_t)(rng() % 401) - 200;
+    axes[i + 5] = (int16_t)(rng() % 4001) - 2000;
+  }
+  int32_t sum = 0;
+  unsigned long allocsBefore = allocations;
+  Clock::time_point start = Clock::now();
+  for (uint32_t i = 0; i < updates; i++) {
+    const int16_t *reading = &axes[6 * (i & 1023)];
+    sum += tiltFilterUpdate(filter, reading, reading + 3, 37, 5000);
+  }
+  double ns = nsSince(start);
+  printf("%-22s %8.1f ns/update  allocs %lu  [%ld]\n", "tilt filter", ns / updates,
+         allocations - allocsBefore, (long)sum);
+  return check(allocations == allocsBefore, "tilt filter", "allocated");
+}
+
+static bool benchTelemetry(uint32_t samples) {
+  TelemetrySample sample = {};
+  sample.status = STATUS_OBJECT | STATUS_DIR_RIGHT;
+  sample.strength = 1234;
+  sample.temperatureDeci = 415;
+  uint8_t frame[SAMPLE_FRAME_LEN];
+  char line[TELEMETRY_TEXT_MAX];
+  uint32_t bytes = 0;
+
+  unsigned long allocsBefore = allocations;
+  Clock::time_point start = Clock::now();
+  for (uint32_t i = 0; i < samples; i++) {
+    sample.seq = i;
+    sample.timestampUs = i * 1000;
+    sample.distance = 10 + (i & 1023);
+    sample.yawCentideg = i % 36000;
+    bytes += telemetryEncodeSample(frame, sample);
+  }
+  double ns = nsSince(start);
+  printf("%-22s %8.1f ns/sample %5.1f B/sample  allocs %lu\n", "encode sample (bin)", ns / samples,
+         (double)bytes / samples, allocations - allocsBefore);
+
+  bytes = 0;
+  start = Clock::now();
+  for (uint32_t i = 0; i < samples; i++) {
+    sample.timestampUs = i * 1000;
+    sample.distance = 10 + (i & 1023);
+    sample.yawCentideg = i % 36000;
+    bytes += telemetryFormatSample(line, sizeof(line), sample);
+  }
+  ns = nsSince(start);
+  printf("%-22s %8.1f ns/sample %5.1f B/sample  allocs %lu\n", "format sample (text)", ns / samples,
+         (double)bytes / samples, allocations - allocsBefore);
+
+  TelemetryStats stats;
+  uint32_t *counters = (uint32_t *)&stats;
+  for (uint8_t i = 0; i < STATS_FIELD_COUNT; i++) counters[i] = rng();
+  bytes = 0;
+  start = Clock::now();
+  for (uint32_t i = 0; i < samples / 10; i++) {
+    stats.lidarFramesOk = i;
+    for (uint8_t field = 0; field < STATS_FIELD_COUNT;) {
+      bytes += telemetryFormatStats(line, sizeof(line), stats, field);
+    }
+  }
+  ns = nsSince(start);
+  printf("%-22s %8.1f ns/record %5.1f B/record  allocs %lu\n", "format stats (text)",
+         ns / (samples / 10), (double)bytes / (samples / 10), allocations - allocsBefore);
+  return check(allocations == allocsBefore, "telemetry", "allocated");
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &out) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const uint32_t FRAMES = 1000000;
+  uint32_t corrupted;
+  bool ok = true;
+
+  std::vector<uint8_t> clean = tfminiStream(FRAMES, 0, 0, corrupted);
+  ok &= benchParser("tfmini clean", clean, FRAMES, corrupted);
+  std::vector<uint8_t> noisy = tfminiStream(FRAMES, 10, 0, corrupted);
+  ok &= benchParser("tfmini 1% corrupt", noisy, FRAMES - corrupted, corrupted);
+  std::vector<uint8_t> chatty = tfminiStream(FRAMES, 10, 5, corrupted);
+  ok &= benchParser("tfmini + responses", chatty, FRAMES - corrupted, corrupted);
+
+  for (int i = 1; i < argc; i++) {
+    std::vector<uint8_t> recorded;
+    if (!readFile(argv[i], recorded)) {
+      fprintf(stderr, "can't read %s\n", argv[i]);
+      return 1;
+    }
+    ok &= benchParser(argv[i], recorded, 0, 0);
+  }
+
+  ok &= benchYaw(10000000);
+  ok &= benchTilt(10000000);
+  ok &= benchTelemetry(1000000);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,46 @@
+#ifndef AGGREGATOR_H
+#define AGGREGATOR_H
+
+#include <stdint.h>
+
+#include "telemetry.h"
+
+// On-device decimation of LiDAR samples before they reach the host link.
+//
+// AGG_BIN_MIN and AGG_BIN_MEDIAN collect the frames that fall into one yaw
+// bin of binCentideg and send a single sample when the scanner moves on to
+// another bin, with the minimum or median distance of the bin. A bin is also
+// closed after periodUs (and, for the median, when AGG_MEDIAN_MAX frames have
+// been collected), so a scanner that stands still keeps reporting.
+//
+// AGG_RATE sends one sample per periodUs: the nearest one seen in that
+// window, so decimation never hides the closest obstacle.
+enum AggregateMode : uint8_t {
+  AGG_NONE,
+  AGG_BIN_MIN,
+  AGG_BIN_MEDIAN,
+  AGG_RATE,
+};
+
+const uint8_t AGG_MEDIAN_MAX = 15;
+
+struct Aggregator {
+  AggregateMode mode;
+  uint16_t binCentideg;
+  uint32_t periodUs;
+
+  TelemetrySample pending; // latest frame of the open window, or its minimum
+  uint8_t count;           // frames in the open window
+  uint16_t bin;
+  uint32_t windowStartUs;
+  uint16_t distances[AGG_MEDIAN_MAX]; // AGG_BIN_MEDIAN only, sorted
+  uint8_t objects[AGG_MEDIAN_MAX];    // STATUS_OBJECT of each distance
+};
+
+void aggregatorInit(Aggregator &agg, AggregateMode mode, uint16_t binCentideg, uint32_t periodUs);
+
+// Adds one frame's sample. Returns true with out filled in when a window
+// closed and its sample should be sent.
+bool aggregatorAdd(Aggregator &agg, const TelemetrySample &in, TelemetrySample &out);
+
+#endif
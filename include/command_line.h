@@ -0,0 +1,25 @@
+#ifndef COMMAND_LINE_H
+#define COMMAND_LINE_H
+
+#include <stdint.h>
+
+// Collects host commands one byte at a time, so reading them never waits for
+// the rest of a line. Lines end with LF (a CR before it is dropped) and are
+// upper-cased; longer lines than COMMAND_LINE_MAX are discarded whole.
+const uint8_t COMMAND_LINE_MAX = 31;
+
+struct CommandLine {
+  char buf[COMMAND_LINE_MAX + 1];
+  uint8_t len;
+  bool overflow;
+};
+
+// Returns true when buf holds a complete, NUL-terminated command. The next
+// call starts a new line.
+bool commandLineFeed(CommandLine &line, uint8_t data);
+
+// Splits a complete line at its first space: returns the argument part (or
+// an empty string) and terminates the command word in place.
+char *commandLineArgs(CommandLine &line);
+
+#endif
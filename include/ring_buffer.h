@@ -0,0 +1,49 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdint.h>
+
+// Lock-free single-producer/single-consumer byte queue, meant to be filled
+// from an ISR and drained from loop(). Indices are single bytes so each side
+// reads the other's index atomically on AVR without disabling interrupts.
+// One slot is kept free, so it holds at most N - 1 bytes.
+template <uint16_t N>
+struct RingBuffer {
+  static_assert(N >= 2 && N <= 256 && (N & (N - 1)) == 0,
+                "RingBuffer size must be a power of two up to 256");
+  static const uint8_t MASK = N - 1;
+
+  volatile uint8_t data[N];
+  volatile uint8_t head;      // written by the producer only
+  volatile uint8_t tail;      // written by the consumer only
+  volatile uint16_t overflows; // bytes dropped because the buffer was full
+  volatile uint8_t highWater; // deepest fill level seen by the producer
+
+  // Producer side
+  bool push(uint8_t value) {
+    uint8_t h = head;
+    uint8_t next = (h + 1) & MASK;
+    if (next == tail) {
+      overflows++;
+      return false;
+    }
+    data[h] = value;
+    head = next;
+    uint8_t fill = (next - tail) & MASK;
+    if (fill > highWater) highWater = fill;
+    return true;
+  }
+
+  // Consumer side
+  bool pop(uint8_t &value) {
+    uint8_t t = tail;
+    if (t == head) return false;
+    value = data[t];
+    tail = (t + 1) & MASK;
+    return true;
+  }
+
+  uint8_t size() const { return (head - tail) & MASK; }
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+// Cooperative task bookkeeping for loop(). Nothing is preempted: loop()
+// asks which task may run and calls it.
+//
+// A periodic task is due once its release time has come. Releases advance by
+// whole periods, so the rate doesn't drift with the time the task takes or
+// how late it started; a task that fell a whole period behind skips the
+// missed releases instead of running back to back to catch up.
+//
+// A background task (periodUs 0) runs whenever loop() has work for it; its
+// release is its last run.
+//
+// Either kind counts a deadline miss when it starts more than deadlineUs
+// after its release.
+struct Task {
+  uint32_t periodUs;   // 0 = background
+  uint32_t deadlineUs;
+  uint32_t releaseUs;
+  uint32_t runs;
+  uint32_t misses;
+  uint32_t maxLateUs;  // latest start after release, since the last reset
+};
+
+void taskInit(Task &task, uint32_t periodUs, uint32_t deadlineUs, uint32_t nowUs);
+
+// For periodic tasks: true when the task is due, and books the run.
+bool taskDue(Task &task, uint32_t nowUs);
+
+// For background tasks: books a run the caller decided on.
+void taskRan(Task &task, uint32_t nowUs);
+
+// Time until a periodic task is released, 0 if it is due.
+uint32_t taskSlackUs(const Task &task, uint32_t nowUs);
+
+// Zeroes runs, misses and maxLateUs.
+void taskResetCounters(Task &task);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef STAGE_TIMER_H
+#define STAGE_TIMER_H
+
+#include <stdint.h>
+
+#include "telemetry.h"
+
+// Min/avg/max accumulator for the time one loop() stage takes.
+struct StageTimer {
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint32_t totalUs;
+  uint32_t count;
+};
+
+inline void stageTimerReset(StageTimer &timer) {
+  timer.minUs = UINT32_MAX;
+  timer.maxUs = 0;
+  timer.totalUs = 0;
+  timer.count = 0;
+}
+
+inline void stageTimerAdd(StageTimer &timer, uint32_t us) {
+  if (us < timer.minUs) timer.minUs = us;
+  if (us > timer.maxUs) timer.maxUs = us;
+  timer.totalUs += us;
+  timer.count++;
+}
+
+inline StageStats stageTimerStats(const StageTimer &timer) {
+  StageStats stats = {0, 0, 0};
+  if (timer.count) {
+    stats.minUs = timer.minUs;
+    stats.avgUs = timer.totalUs / timer.count;
+    stats.maxUs = timer.maxUs;
+  }
+  return stats;
+}
+
+#endif
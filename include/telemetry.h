@@ -0,0 +1,136 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary telemetry frame (all multi-byte fields little-endian):
+//
+//   A5 5A | type | len | payload[len] | crc16
+//
+// crc16 is CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) over type, len and
+// payload. The host decoder skips unknown types and ignores payload bytes
+// past the fields it knows, so new fields are only ever appended.
+const uint8_t TELEMETRY_SYNC0 = 0xA5;
+const uint8_t TELEMETRY_SYNC1 = 0x5A;
+const uint8_t TELEMETRY_OVERHEAD = 6; // sync, type, len, crc
+
+enum TelemetryFrameType : uint8_t {
+  FRAME_SAMPLE = 0x01,
+  FRAME_STATS = 0x02,
+  FRAME_LOOP_STATS = 0x03,
+};
+
+// Sample status bitfield
+const uint8_t STATUS_OBJECT = 0x01;    // distance below range limit
+const uint8_t STATUS_MOVING = 0x02;    // |GyroZ| above threshold
+const uint8_t STATUS_DIR_RIGHT = 0x04;
+const uint8_t STATUS_DIR_LEFT = 0x08;
+// Bits 4..6 carry the sample's sensor ID, so single-sensor hosts that only
+// test the flags above keep working. Bit 7 is reserved.
+const uint8_t STATUS_SENSOR_SHIFT = 4;
+const uint8_t STATUS_SENSOR_MASK = 0x70;
+const uint8_t TELEMETRY_MAX_SENSORS = 8;
+
+struct TelemetrySample {
+  uint16_t seq;
+  uint32_t timestampUs;    // micros() when the LiDAR frame started arriving
+  uint16_t distance;       // cm
+  uint16_t yawCentideg;    // 0..35999
+  uint8_t status;
+  uint16_t strength;       // TFmini signal strength
+  int16_t temperatureDeci; // TFmini chip temperature, 0.1 °C
+  uint8_t sensor;          // LiDAR unit, 0 .. TELEMETRY_MAX_SENSORS - 1
+};
+
+// Periodic device counters, sent as consecutive uint32 values in this order.
+struct TelemetryStats {
+  uint32_t lidarFramesOk;
+  uint32_t lidarChecksumErrors;
+  uint32_t lidarResyncs;
+  uint32_t lidarRxOverflows; // bytes lost before reaching the parser
+  uint32_t lidarRxHighWater; // deepest RX ring buffer fill (LIDAR_RX_ISR)
+  uint32_t imuFifoOverflows; // MPU6050 FIFO resets after overflow (IMU_FIFO)
+  uint32_t i2cReadUsAvg;     // gyro read transaction time over the last interval
+  uint32_t i2cReadUsMax;
+  uint32_t samplesSent;      // after decimation, compare with lidarFramesOk
+  uint32_t lidarFrameRate;   // good frames per second, measured, all units together
+  uint32_t lidarResponses;   // command responses seen from the sensor
+  uint32_t lidarWeakFrames;  // rejected for low or saturated signal strength
+  uint32_t biasUpdates;      // gyro readings the background bias tracker used
+  uint32_t txDrops;          // records dropped because the TX queue was full
+  uint32_t txHighWater;      // deepest TX queue fill level, bytes
+};
+
+// loop() over the last stats interval: per-stage timing in microseconds
+// (LOOP_STATS builds, zero otherwise; tx is the time spent handing queued
+// records to Serial) and the scheduler's deadline misses per task (see
+// scheduler.h), with how late the IMU task started at worst.
+struct StageStats {
+  uint32_t minUs;
+  uint32_t avgUs;
+  uint32_t maxUs;
+};
+
+struct TelemetryLoopStats {
+  uint32_t loopsPerSecond;
+  StageStats imu;
+  StageStats lidar;
+  StageStats tx;
+  StageStats cmd;
+  uint32_t imuMisses;
+  uint32_t imuLateMaxUs;
+  uint32_t lidarMisses;
+  uint32_t hostMisses;
+};
+
+const uint8_t SAMPLE_PAYLOAD_LEN = 15;
+const uint8_t SAMPLE_FRAME_LEN = SAMPLE_PAYLOAD_LEN + TELEMETRY_OVERHEAD;
+const uint8_t STATS_PAYLOAD_LEN = sizeof(TelemetryStats);
+const uint8_t STATS_FRAME_LEN = STATS_PAYLOAD_LEN + TELEMETRY_OVERHEAD;
+const uint8_t LOOP_STATS_PAYLOAD_LEN = sizeof(TelemetryLoopStats);
+const uint8_t LOOP_STATS_FRAME_LEN = LOOP_STATS_PAYLOAD_LEN + TELEMETRY_OVERHEAD;
+
+const uint8_t STATS_FIELD_COUNT = STATS_PAYLOAD_LEN / 4;
+const uint8_t LOOP_STATS_FIELD_COUNT = LOOP_STATS_PAYLOAD_LEN / 4;
+
+// Text line buffer size, including the trailing CR LF. Enough for any sample
+// line and for at least four stats or loop fields with 10-digit values; stats
+// and loop records are split into as many lines as their values need, so no
+// counter is ever left out.
+const uint8_t TELEMETRY_TEXT_MAX = 144;
+
+uint16_t crc16Update(uint16_t crc, uint8_t data);
+
+// Writes a complete sample frame into buf (at least SAMPLE_FRAME_LEN bytes)
+// and returns its length.
+size_t telemetryEncodeSample(uint8_t *buf, const TelemetrySample &sample);
+
+// Same for a stats frame (at least STATS_FRAME_LEN bytes) and a loop
+// timing frame (LOOP_STATS_FRAME_LEN).
+size_t telemetryEncodeStats(uint8_t *buf, const TelemetryStats &stats);
+size_t telemetryEncodeLoopStats(uint8_t *buf, const TelemetryLoopStats &stats);
+
+// Text equivalents of the frames above: one CR LF terminated key=value line
+// written into buf (not NUL-terminated). The field names and status words
+// live in flash, so formatting allocates nothing.
+size_t telemetryFormatSample(char *buf, size_t size, const TelemetrySample &sample);
+
+// A stats or loop record doesn't fit one line, so it goes out as several
+// "type=stats" (or "type=loop") lines of whole fields, which the host merges.
+// Each call writes the line starting at field and advances field past it;
+// the record is complete when field reaches STATS_FIELD_COUNT (or
+// LOOP_STATS_FIELD_COUNT).
+size_t telemetryFormatStats(char *buf, size_t size, const TelemetryStats &stats, uint8_t &field);
+size_t telemetryFormatLoopStats(char *buf, size_t size, const TelemetryLoopStats &stats,
+                                uint8_t &field);
+
+// "type=ack,cmd=<command>,ok=<0|1>", the reply to a host command. Sent as
+// text in both protocols; the host decoder accepts lines between frames.
+size_t telemetryFormatAck(char *buf, size_t size, const char *command, bool ok);
+
+// "type=hello,baud=<rate>,proto=<text|bin>", the reply to PING. The host uses
+// it to find the device and to confirm a BAUD switch.
+size_t telemetryFormatHello(char *buf, size_t size, uint32_t baud, bool binary);
+
+#endif
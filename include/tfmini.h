@@ -0,0 +1,74 @@
+#ifndef TFMINI_H
+#define TFMINI_H
+
+#include <stdint.h>
+
+// TFmini Plus standard 9-byte output frame:
+//
+//   59 59 | dist_L dist_H | strength_L strength_H | temp_L temp_H | checksum
+//
+// checksum is the low byte of the sum of the first eight bytes.
+const uint8_t TFMINI_HEADER = 0x59;
+const uint8_t TFMINI_FRAME_LEN = 9;
+
+// Command frames, and the sensor's responses to them:
+//
+//   5A | len | id | payload | checksum
+//
+// len counts the whole frame, checksum is again the low byte of the sum.
+const uint8_t TFMINI_CMD_HEADER = 0x5A;
+const uint8_t TFMINI_CMD_MAX = 8;
+const uint8_t TFMINI_ID_GET_FRAME = 0x00;     // payload: TFMINI_FORMAT_*, I2C mode: next read is a frame
+const uint8_t TFMINI_ID_FRAME_RATE = 0x03;    // payload: uint16 Hz (0 = on trigger only)
+const uint8_t TFMINI_ID_OUTPUT_FORMAT = 0x05; // payload: TFMINI_FORMAT_*
+const uint8_t TFMINI_ID_SAVE_SETTINGS = 0x11;
+const uint8_t TFMINI_FORMAT_CM = 0x01;        // standard 9-byte frame, distance in cm
+
+// Incremental frame parser. Feed it every received byte; it never blocks and
+// never needs more than the byte it is given. After a checksum failure it
+// rescans the bytes it already holds for the next header instead of
+// discarding the whole frame. Command responses are skipped and counted.
+struct TFminiParser {
+  uint8_t frame[TFMINI_FRAME_LEN];
+  uint8_t pos;
+  bool synced;
+  uint8_t skip; // bytes left of a command response
+
+  uint32_t framesOk;
+  uint32_t checksumErrors;
+  uint32_t resyncs; // times the header was lost and had to be hunted for
+  uint32_t responses;
+};
+
+void tfminiReset(TFminiParser &parser);
+
+// Returns true when parser.frame holds a complete frame with a valid checksum.
+bool tfminiFeed(TFminiParser &parser, uint8_t data);
+
+// Writes a command frame into buf (at least TFMINI_CMD_MAX bytes) and
+// returns its length.
+uint8_t tfminiCommand(uint8_t *buf, uint8_t id, const uint8_t *payload, uint8_t len);
+uint8_t tfminiFrameRateCommand(uint8_t *buf, uint16_t hz);
+
+inline uint16_t tfminiDistance(const TFminiParser &parser) {
+  return parser.frame[2] | (uint16_t)parser.frame[3] << 8;
+}
+
+inline uint16_t tfminiStrength(const TFminiParser &parser) {
+  return parser.frame[4] | (uint16_t)parser.frame[5] << 8;
+}
+
+inline uint16_t tfminiRawTemperature(const TFminiParser &parser) {
+  return parser.frame[6] | (uint16_t)parser.frame[7] << 8;
+}
+
+// Chip temperature in 0.1 °C (raw / 8 - 256 °C)
+inline int16_t tfminiTemperatureDeci(const TFminiParser &parser) {
+  return (int16_t)((int32_t)tfminiRawTemperature(parser) * 10 / 8 - 2560);
+}
+
+// The datasheet marks distances unreliable below strength 100, and 65535
+// means the receiver saturated (retroreflector or too close).
+const uint16_t TFMINI_STRENGTH_SATURATED = 65535;
+
+#endif
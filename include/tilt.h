@@ -0,0 +1,43 @@
+#ifndef TILT_H
+#define TILT_H
+
+#include <stdint.h>
+
+// Tilt compensation for the yaw integrator (IMU_FUSION builds), for the
+// MPU6050 at ±8 g (4096 LSB/g) and ±1000 °/s.
+//
+// A complementary filter keeps the direction of gravity in the sensor frame:
+// each reading rotates it by the gyro's three axes over dt, then pulls it
+// 1 / 2^TILT_SHIFT of the way towards the accelerometer, which is noisy and
+// upset by acceleration but doesn't drift. From it, tiltFilterUpdate() turns
+// the GyroZ reading into the turn rate about the vertical, in GyroZ units,
+// so yawUpdate() and the bias tracker can take it unchanged. When the sensor
+// sits level the reading passes through as it is.
+//
+// Gravity says nothing about rotation around it: this removes the heading
+// error that tilt and wobble feed into GyroZ, not the drift of the gyro
+// bias, which still takes the background bias tracker (or a magnetometer).
+//
+// Integer only: a handful of 32-bit multiplies, one integer square root and
+// one division per reading.
+const uint8_t TILT_SHIFT = 8; // about 1.3 s at 200 Hz
+
+// One step of the gravity rotation is clamped to this, µs; longer gaps are
+// stalls, and the accelerometer pulls the estimate back.
+const uint16_t TILT_MAX_DT_US = 32767;
+
+struct TiltFilter {
+  int32_t up[3];       // measured gravity direction, accel LSB * 4
+  int16_t gyroBias[2]; // X and Y gyro zero offsets, LSB
+};
+
+// accel is an (averaged) reading at rest; biasX and biasY the gyro offsets.
+void tiltFilterInit(TiltFilter &filter, const int16_t accel[3], int16_t biasX, int16_t biasY);
+
+// accel and gyro are one ACCEL_XOUT..GYRO_ZOUT burst (X, Y, Z each), biasZ
+// the current GyroZ offset. Returns GyroZ as it would read with its axis
+// vertical.
+int16_t tiltFilterUpdate(TiltFilter &filter, const int16_t accel[3], const int16_t gyro[3],
+                         int16_t biasZ, uint32_t dtUs);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef TX_QUEUE_H
+#define TX_QUEUE_H
+
+#include <stdint.h>
+
+// Bounded queue of whole telemetry records (frames or text lines) on their
+// way to the host. loop() only hands Serial as many bytes as it can take
+// without blocking (availableForWrite()), so a slow or stalled host costs
+// dropped records instead of a stalled gyro integration.
+//
+// When a new record doesn't fit, the policy decides what is dropped:
+//   TX_DROP_OLDEST  queued records, oldest first, until it fits; on a link
+//                   that stays saturated that includes stats and acks
+//   TX_DROP_NEWEST  the new sample; a new stats record or ack instead drops
+//                   queued samples, oldest first, as TX_COALESCE does, so the
+//                   host still hears from the device when samples back up
+//   TX_COALESCE     queued samples, oldest first, so the latest sample always
+//                   gets through; stats and acks stay queued, and a record
+//                   that still doesn't fit is dropped
+// A record that has started going out is never dropped, so the host doesn't
+// see torn frames.
+enum TxDropPolicy : uint8_t {
+  TX_DROP_OLDEST,
+  TX_DROP_NEWEST,
+  TX_COALESCE,
+};
+
+#ifndef TX_QUEUE_SIZE
+#define TX_QUEUE_SIZE 256
+#endif
+const uint8_t TX_QUEUE_RECORDS = 16;
+
+struct TxRecord {
+  uint8_t len;
+  bool sample;
+};
+
+struct TxQueue {
+  TxDropPolicy policy;
+  uint8_t data[TX_QUEUE_SIZE];
+  uint16_t head;     // next byte to send
+  uint16_t used;     // bytes queued, including the unsent rest of the first record
+  uint8_t headSent;  // bytes of the first record already sent
+  TxRecord records[TX_QUEUE_RECORDS];
+  uint8_t first;     // index of the oldest record in records
+  uint8_t count;
+  uint32_t drops;    // records dropped by the policy
+  uint16_t highWater; // most bytes queued at once
+};
+
+void txQueueInit(TxQueue &q, TxDropPolicy policy);
+
+// Queues one record; sample marks it as a sample for TX_COALESCE. Returns
+// false if the record itself was dropped.
+bool txQueuePush(TxQueue &q, const uint8_t *data, uint8_t len, bool sample);
+
+// Points data at the next contiguous run of bytes to send and returns its
+// length (0 when empty). Call txQueueConsume() with how many were sent.
+uint16_t txQueuePeek(const TxQueue &q, const uint8_t *&data);
+void txQueueConsume(TxQueue &q, uint16_t sent);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef YAW_H
+#define YAW_H
+
+#include <stdint.h>
+
+// Fixed-point heading integration for the MPU6050 Z gyro at ±1000 °/s
+// (32.8 LSB per °/s).
+//
+// Rates are kept in 1/16 LSB so the bias can be subtracted with sub-LSB
+// precision. The angle unit is 1/16 LSB * 256 us, which puts a full turn at
+// 738,000,000 and keeps it in an int32. Each step needs only 32-bit integer
+// multiplies; the part of rate * dt below one unit is carried over, so
+// nothing is lost to truncation however short dt gets.
+const int32_t YAW_UNITS_PER_CENTIDEG = 20500;
+const int32_t YAW_UNITS_PER_TURN = 36000L * YAW_UNITS_PER_CENTIDEG;
+const int16_t GYRO_Q4_PER_DPS = 525; // 32.8 LSB * 16, rounded
+
+// Longest step integrated in one go; a longer gap means the loop stalled and
+// the held rate is a guess anyway.
+const uint16_t YAW_MAX_DT_US = 65535;
+
+struct YawIntegrator {
+  int32_t angle;    // 0 .. YAW_UNITS_PER_TURN - 1
+  int32_t residual; // below one angle unit, in 1/16 LSB * us
+  int32_t biasQ4;   // gyro zero offset, 1/16 LSB
+  int32_t rateQ4;   // last bias-corrected rate, 1/16 LSB
+};
+
+void yawReset(YawIntegrator &yaw);
+
+// Integrates one raw GYRO_ZOUT reading held for dtUs microseconds.
+void yawUpdate(YawIntegrator &yaw, int16_t raw, uint32_t dtUs);
+
+// Nearest centidegree, rounded the way Serial.print(yaw, 2) used to
+inline uint16_t yawAngleCentideg(int32_t angle) {
+  int32_t centideg = (angle + YAW_UNITS_PER_CENTIDEG / 2) / YAW_UNITS_PER_CENTIDEG;
+  return centideg < 36000 ? centideg : 0;
+}
+
+inline uint16_t yawCentideg(const YawIntegrator &yaw) {
+  return yawAngleCentideg(yaw.angle);
+}
+
+// Heading offsetUs away from the last update, assuming the last rate held.
+// Negative offsets interpolate back towards the previous sample, positive
+// ones extrapolate. Clamped to ±YAW_MAX_DT_US.
+uint16_t yawCentidegAt(const YawIntegrator &yaw, int32_t offsetUs);
+
+// Background gyro bias tracking. Once the corrected rate, low-pass filtered
+// against sensor noise, has stayed below stillThresholdQ4 for
+// BIAS_SETTLE_US, every further reading pulls the bias towards itself with
+// an exponential mean (weight 1 / 2^BIAS_SHIFT). Long sessions then follow
+// the bias as the sensor warms up, and startup only needs a rough first
+// estimate. A turn slower than the threshold would be learnt as bias, so
+// keep it well under any real scan speed.
+const uint32_t BIAS_SETTLE_US = 500000;
+const uint8_t BIAS_SHIFT = 9;
+
+struct BiasTracker {
+  int32_t stillThresholdQ4;
+  int32_t biasQ12;  // yaw.biasQ4 with 8 more fraction bits
+  int32_t rateQ4;   // filtered corrected rate
+  uint32_t stillUs; // time the rate has been below the threshold
+  uint32_t updates;
+};
+
+void biasTrackerInit(BiasTracker &tracker, int32_t stillThresholdQ4, int32_t biasQ4);
+
+// Call after yawUpdate() with the same reading; may adjust yaw.biasQ4.
+void biasTrackerUpdate(BiasTracker &tracker, YawIntegrator &yaw, int16_t raw, uint32_t dtUs);
+
+#endif
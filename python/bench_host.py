@@ -0,0 +1,137 @@
+"""Benchmark of the host hot paths: StreamDecoder on text and binary
+telemetry, parse_line() on its own, and ScanMap updates.
+
+    python bench_host.py [--replay LOG ...]
+
+Streams are synthetic (fixed seed) unless stream logs recorded with
+plot_lidar.py --record are given, which are decoded as well. Exits non-zero
+if the decoder loses, invents or miscounts records in the synthetic streams
+or the scan map misses bins, like its native counterpart for the firmware
+side, bench/bench_native.cpp.
+"""
+import argparse
+import binascii
+import random
+import struct
+import sys
+import time
+
+from scan_map import ScanMap
+from stream_log import StreamLog
+from telemetry import FRAME_SAMPLE, SAMPLE_STRUCT, StreamDecoder, parse_line
+
+SAMPLES = 200000
+CHUNK = 4096  # bytes per feed(), about one read at 1 Mbaud
+
+
+def frame(frame_type, payload):
+    body = bytes([frame_type, len(payload)]) + payload
+    return b"\xa5\x5a" + body + struct.pack("<H", binascii.crc_hqx(body, 0xFFFF))
+
+
+def synthetic_streams(rng):
+    text = bytearray()
+    binary = bytearray()
+    for i in range(SAMPLES):
+        dist = rng.randint(10, 1200)
+        yaw = rng.randint(0, 35999)
+        text += (b"distance=%d,yaw=%d.%02d,direction=Right,object=Detected,gyro=Moving,"
+                 b"t_us=%d,strength=%d,temp=41.5\r\n" % (dist, yaw // 100, yaw % 100, i * 1000, 500))
+        binary += frame(FRAME_SAMPLE, SAMPLE_STRUCT.pack(i & 0xFFFF, i * 1000, dist, yaw, 5, 500, 415))
+    return bytes(text), bytes(binary)
+
+
+def check(ok, bench, what):
+    """Reports a failed check on stderr and returns ok."""
+    if not ok:
+        print(f"FAIL {bench}: {what}", file=sys.stderr)
+    return ok
+
+
+def corrupt(data, rng, flips):
+    """Flips one bit in `flips` random bytes."""
+    data = bytearray(data)
+    for _ in range(flips):
+        data[rng.randrange(len(data))] ^= 1 << rng.randrange(8)
+    return bytes(data)
+
+
+def bench_decoder(name, chunks, expected=None, flips=0):
+    """expected is None for a replay, whose sample count isn't known."""
+    decoder = StreamDecoder()
+    records = 0
+    samples = 0
+    start = time.perf_counter()
+    for chunk in chunks:
+        decoded = decoder.feed(chunk)
+        records += len(decoded)
+        samples += sum(1 for record in decoded if "distance" in record)
+    elapsed = time.perf_counter() - start
+    print(f"{name:24} {elapsed / max(records, 1) * 1e9:8.0f} ns/record {records / elapsed:10.0f} records/s"
+          f"  records {records}  errors {decoder.errors} (crc {decoder.crc_errors})")
+    if expected is None:
+        return True
+    if not flips:
+        return (check(samples == expected == records, name, f"{samples} samples, expected {expected}")
+                & check(decoder.errors == 0, name, f"{decoder.errors} errors on a clean stream"))
+    # A flipped length byte can take a couple of frames with it, but a frame
+    # that fails its CRC is never passed on
+    return (check(expected - 2 * flips <= samples <= expected, name,
+                  f"{samples} samples, expected {expected} less up to {2 * flips}")
+            & check(0 < decoder.crc_errors <= flips, name,
+                    f"{decoder.crc_errors} crc errors for {flips} flipped bits"))
+
+
+def chunked(data):
+    return [data[i:i + CHUNK] for i in range(0, len(data), CHUNK)]
+
+
+def bench_parse_line(text):
+    lines = text.decode().splitlines()
+    start = time.perf_counter()
+    for line in lines:
+        parse_line(line)
+    elapsed = time.perf_counter() - start
+    print(f"{'parse_line':24} {elapsed / len(lines) * 1e9:8.0f} ns/line")
+
+
+def bench_scan_map(rng, resolution=0.25):
+    scan = ScanMap(resolution)
+    angles = [rng.uniform(0.0, 180.0) for _ in range(SAMPLES)]
+    start = time.perf_counter()
+    for i, angle in enumerate(angles):
+        scan.update(angle, 30.0, True, i)
+    elapsed = time.perf_counter() - start
+    start = time.perf_counter()
+    filled = scan.filled()
+    walk = time.perf_counter() - start
+    print(f"{'ScanMap.update':24} {elapsed / SAMPLES * 1e9:8.0f} ns/update"
+          f"  filled() {walk * 1e6:.0f} us for {len(filled)} of {scan.bins} bins")
+    # SAMPLES random angles over the half turn reach every bin
+    return check(len(filled) == scan.bins, "ScanMap", f"{len(filled)} of {scan.bins} bins filled")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--replay", metavar="LOG", nargs="*", default=[],
+                        help="stream logs to decode as well")
+    args = parser.parse_args()
+
+    rng = random.Random(1)
+    text, binary = synthetic_streams(rng)
+    ok = bench_decoder("decode text", chunked(text), SAMPLES)
+    ok &= bench_decoder("decode binary", chunked(binary), SAMPLES)
+    flips = SAMPLES // 100
+    ok &= bench_decoder("decode binary, 1% bad", chunked(corrupt(binary, rng, flips)), SAMPLES, flips)
+    bench_parse_line(text[:len(text) // 10])
+    ok &= bench_scan_map(rng)
+
+    for path in args.replay:
+        log = StreamLog(path)
+        bench_decoder(path, [bytes(data) for _, data in log.records()])
+        log.close()
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,143 @@
+"""Host pipeline instrumentation: ingest, errors, render timing and
+sensor-to-screen latency, for the plot_lidar.py overlay and --stats-dump.
+
+Latency needs the firmware's t_us sample timestamps. The device clock is
+mapped onto the host clock with the smallest (arrival - t_us) difference
+seen over the last couple of seconds, so the reported latency is the delay
+on top of the fastest sample's: queueing, decoding and drawing, not the
+fixed wire time. Dropped samples are counted from gaps in the binary seq
+numbers (text samples don't carry one).
+"""
+import csv
+import json
+import time
+from collections import deque
+
+WINDOW = 240           # frames / samples kept for percentiles
+OFFSET_BLOCK_S = 1.0   # min offset is taken over the last two blocks
+
+
+def percentile(values, q):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(q * len(ordered)))]
+
+
+class HostStats:
+    def __init__(self):
+        self.frame_ms = deque(maxlen=WINDOW)
+        self.latency_ms = deque(maxlen=WINDOW)
+        self.frames = 0
+        self.fps = 0.0
+        self.window_start = time.perf_counter()
+        self.window_frames = 0
+        self.last_seq = None
+        self.seq_drops = 0
+        self.t_us_last = None
+        self.t_us_wraps = 0
+        self.offset_blocks = deque(maxlen=2)  # (block start, min offset)
+        self.frame_samples = []               # device times drawn this frame
+
+    def _device_seconds(self, t_us):
+        # t_us is a u32 that wraps every ~71 minutes
+        if self.t_us_last is not None and t_us < self.t_us_last - 0x80000000:
+            self.t_us_wraps += 1
+        self.t_us_last = t_us
+        return (self.t_us_wraps * 0x100000000 + t_us) / 1e6
+
+    def sample(self, record, now):
+        """Account for one drained sample record; now is the drain time."""
+        seq = record.get("seq")
+        if seq is not None:
+            if self.last_seq is not None:
+                gap = (seq - self.last_seq - 1) & 0xFFFF
+                if gap < 0x8000:
+                    self.seq_drops += gap
+            self.last_seq = seq
+        t_us = record.get("t_us")
+        if t_us is None:
+            return
+        device = self._device_seconds(int(t_us))
+        offset = now - device
+        if not self.offset_blocks or now - self.offset_blocks[-1][0] >= OFFSET_BLOCK_S:
+            self.offset_blocks.append((now, offset))
+        elif offset < self.offset_blocks[-1][1]:
+            self.offset_blocks[-1] = (self.offset_blocks[-1][0], offset)
+        self.frame_samples.append(device)
+
+    def frame(self, start, shown):
+        """A frame that started at start was put on screen at shown."""
+        self.frames += 1
+        self.window_frames += 1
+        self.frame_ms.append((shown - start) * 1000.0)
+        if self.frame_samples and self.offset_blocks:
+            offset = min(block[1] for block in self.offset_blocks)
+            for device in self.frame_samples:
+                self.latency_ms.append(max(0.0, (shown - device - offset) * 1000.0))
+        self.frame_samples = []
+        elapsed = shown - self.window_start
+        if elapsed >= 1.0:
+            self.fps = self.window_frames / elapsed
+            self.window_start = shown
+            self.window_frames = 0
+
+    def snapshot(self, link_rate, reader):
+        frame = list(self.frame_ms)
+        latency = list(self.latency_ms)
+        return {
+            "time": round(time.time(), 3),
+            "samples_per_s": round(link_rate["samples"], 1),
+            "bytes_per_s": round(link_rate["bytes"], 1),
+            "decode_errors": reader.decoder.errors,
+            "crc_errors": reader.decoder.crc_errors,
+            "host_drops": reader.dropped,
+            "queue_depth": len(reader.records),
+            "fps": round(self.fps, 1),
+            "frame_ms_p50": round(percentile(frame, 0.50), 2),
+            "frame_ms_p95": round(percentile(frame, 0.95), 2),
+            "frame_ms_p99": round(percentile(frame, 0.99), 2),
+            "latency_ms_p50": round(percentile(latency, 0.50), 2) if latency else None,
+            "latency_ms_p95": round(percentile(latency, 0.95), 2) if latency else None,
+            "seq_drops": self.seq_drops if self.last_seq is not None else None,
+        }
+
+    def overlay_lines(self, snap):
+        lines = [
+            f"Ingest: {snap['samples_per_s']:.0f} samples/s, {snap['bytes_per_s'] / 1000:.1f} kB/s",
+            f"Errors: decode {snap['decode_errors']} (crc {snap['crc_errors']}), "
+            f"host drops {snap['host_drops']}, queue {snap['queue_depth']}",
+            f"Render: {snap['fps']:.0f} fps, frame {snap['frame_ms_p50']:.1f}/"
+            f"{snap['frame_ms_p95']:.1f}/{snap['frame_ms_p99']:.1f} ms (p50/95/99)",
+        ]
+        if snap["latency_ms_p50"] is None:
+            lines.append("Latency: n/a (no t_us)")
+        else:
+            lines.append(f"Latency: {snap['latency_ms_p50']:.1f}/{snap['latency_ms_p95']:.1f} ms (p50/95)")
+        if snap["seq_drops"] is None:
+            lines.append("Sensor drops: n/a (no seq in text mode)")
+        else:
+            lines.append(f"Sensor drops: {snap['seq_drops']}")
+        return lines
+
+
+class StatsDump:
+    """Appends snapshots to a CSV file, or to JSON lines for a .json/.jsonl path."""
+
+    def __init__(self, path):
+        self.file = open(path, "w", newline="")
+        self.json = path.endswith((".json", ".jsonl"))
+        self.writer = None
+
+    def write(self, snap):
+        if self.json:
+            self.file.write(json.dumps(snap) + "\n")
+        else:
+            if self.writer is None:
+                self.writer = csv.DictWriter(self.file, fieldnames=list(snap))
+                self.writer.writeheader()
+            self.writer.writerow(snap)
+        self.file.flush()
+
+    def close(self):
+        self.file.close()
@@ -1,3 +1,4 @@
+import argparse
 import os
 import sys
 import serial
@@ -5,34 +6,123 @@ import serial.tools.list_ports
 import pygame
 import time
 import math
+from bisect import bisect_left, bisect_right
 from collections import deque
+from host_stats import HostStats, StatsDump
+from scan_map import ScanMap
+from serial_reader import SerialReader
+from stream_log import ReplaySource, StreamRecorder
+from telemetry import StreamDecoder
 
 # ===== SETTINGS =====
+parser = argparse.ArgumentParser(description="Object scanner radar view")
+parser.add_argument("--eco", action="store_true",
+                    help="redraw only what changed (E toggles)")
+parser.add_argument("--record", metavar="LOG",
+                    help="also write the raw serial stream to LOG")
+parser.add_argument("--replay", metavar="LOG",
+                    help="play LOG back instead of opening the scanner")
+parser.add_argument("--speed", type=float, default=1.0,
+                    help="replay speed, 1 = real time, 0 = as fast as possible")
+parser.add_argument("--stats-dump", metavar="FILE",
+                    help="write host pipeline stats every second, CSV or .json lines")
+args = parser.parse_args()
+
+HOST_BAUD = 115200           # firmware boot rate (HOST_BAUD in main.cpp)
+LINK_BAUDS = (1000000, 500000, 250000)  # tried fastest first after connecting
+BOOT_WAIT_S = 3.0            # opening the port resets most boards
+HANDSHAKE_TIMEOUT_S = 0.3
+BAUD_CONFIRM_S = 1.0         # BAUD_CONFIRM_MS in main.cpp
+
+
+def wait_for(ser, match, timeout):
+    """Read until a record for which match() is true arrives (None on timeout)."""
+    decoder = StreamDecoder()
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        for record in decoder.feed(ser.read(max(1, ser.in_waiting))):
+            if match(record):
+                return record
+    return None
+
+
+def ping(ser):
+    """PING handshake: returns the device's type=hello record, or None."""
+    ser.reset_input_buffer()
+    ser.write(b"\nPING\n")  # leading newline ends any garbled partial command
+    return wait_for(ser, lambda r: r.get("type") == "hello", HANDSHAKE_TIMEOUT_S)
+
+
+def open_scanner(port_name):
+    """Open a port at HOST_BAUD and return it if the scanner answers PING."""
+    try:
+        ser = serial.Serial(port_name, HOST_BAUD, timeout=0.05)
+    except (serial.SerialException, OSError):
+        return None
+    deadline = time.time() + BOOT_WAIT_S
+    while time.time() < deadline:
+        if ping(ser):
+            return ser
+    ser.close()
+    return None
+
+
 def find_arduino_port():
-    """Auto-detect Arduino COM port"""
-    ports = serial.tools.list_ports.comports()
-    for port in ports:
-        if any(keyword in port.description.upper() for keyword in 
-               ['ARDUINO', 'CH340', 'CH341', 'FTDI', 'USB-SERIAL']):
-            return port.device
-    
-    # Try common ports if no Arduino found
-    for port_name in ['COM3', 'COM4', 'COM5', 'COM6', 'COM7', 'COM8']:
-        try:
-            test_port = serial.Serial(port_name, 9600, timeout=1)
-            test_port.close()
-            return port_name
-        except:
-            continue
+    """Auto-detect the scanner and return its port, open at HOST_BAUD.
+
+    Likely USB serial adapters are probed first, then common COM ports; a port
+    only counts once the firmware answers the PING handshake.
+    """
+    candidates = [port.device for port in serial.tools.list_ports.comports()
+                  if any(keyword in port.description.upper() for keyword in
+                         ['ARDUINO', 'CH340', 'CH341', 'FTDI', 'USB-SERIAL'])]
+    candidates += [name for name in ['COM3', 'COM4', 'COM5', 'COM6', 'COM7', 'COM8']
+                   if name not in candidates]
+    for name in candidates:
+        ser = open_scanner(name)
+        if ser:
+            return ser
     return None
 
-BAUD = 9600
+
+def negotiate_baud(ser):
+    """Switch the link to the fastest of LINK_BAUDS that passes the handshake.
+
+    The firmware acks BAUD at the old rate, then switches; if no PING arrives
+    at the new rate within BAUD_CONFIRM_MS it goes back on its own, so a rate
+    the adapter can't do costs about a second and we try the next one.
+    """
+    for baud in LINK_BAUDS:
+        if baud <= ser.baudrate:
+            break
+        ser.reset_input_buffer()
+        ser.write(f"\nBAUD {baud}\n".encode())
+        ack = wait_for(ser, lambda r: r.get("type") == "ack" and r.get("cmd") == "BAUD",
+                       HANDSHAKE_TIMEOUT_S)
+        if not ack:
+            time.sleep(BAUD_CONFIRM_S)  # it may have switched anyway
+            continue
+        if ack.get("ok") != "1":
+            continue
+        old = ser.baudrate
+        ser.baudrate = baud
+        for _ in range(2):
+            hello = ping(ser)
+            if hello and hello.get("baud") == str(baud):
+                return baud
+        ser.baudrate = old
+        time.sleep(BAUD_CONFIRM_S)
+        ping(ser)
+    return ser.baudrate
+
 WIDTH, HEIGHT = 1400, 900
 CENTER_X, CENTER_Y = WIDTH // 2 - 100, int(HEIGHT // 1.4)
 MAX_CM = 70
 SCALE = 7                    # pixels per cm
 MAP_SMOOTH_N = 8             # heavier smoothing for map points
 BEAM_SMOOTH_N = 2            # minimal smoothing for beam
+SCAN_RESOLUTION = 0.25       # degrees per scan map bin
+ECO_REDRAW = args.eco        # redraw only what changed (E toggles)
 
 # Colors
 BLACK = (0, 0, 0)
@@ -47,15 +137,20 @@ DARK_GRAY = (30, 30, 30)
 BLUE = (100, 150, 255)
 
 # ===== SERIAL =====
-PORT = find_arduino_port()
-if PORT is None:
-    print("No Arduino found! Check connection and drivers.")
-    input("Press Enter to exit...")
-    exit()
-
-print(f"Arduino found on {PORT}")
-ser = serial.Serial(PORT, BAUD, timeout=1)
-time.sleep(2)
+if args.replay:
+    ser = ReplaySource(args.replay, args.speed)
+    print(f"Replaying {args.replay} ({ser.log.duration_us / 1e6:.1f} s)")
+else:
+    ser = find_arduino_port()
+    if ser is None:
+        print("No Arduino found! Check connection and drivers.")
+        input("Press Enter to exit...")
+        exit()
+
+    print(f"Arduino found on {ser.port}")
+    print(f"Link at {negotiate_baud(ser)} baud")
+reader = SerialReader(ser, recorder=StreamRecorder(args.record) if args.record else None)
+reader.start()
 
 # ===== PYGAME =====
 pygame.init()
@@ -97,31 +192,61 @@ minimized = False
 MINI_WIDTH, MINI_HEIGHT = 400, 300
 
 # ===== STATE =====
-map_dist_hist = deque(maxlen=MAP_SMOOTH_N)
-map_yaw_hist = deque(maxlen=MAP_SMOOTH_N)
 beam_yaw_hist = deque(maxlen=BEAM_SMOOTH_N)
 
-sensor = {
-    "distance_raw": 0.0,
-    "yaw_raw": 90.0,
-    "yaw_instant": 90.0,
-    "direction": "Stationary",
-    "object": "None",
-    "gyro": "Still",
-}
+# Per-sensor state, keyed by the sensor ID in the samples: every LiDAR unit
+# gets its own smoothing and scan map, drawn in its own colour over the same
+# grid. The beam and the status cards follow PRIMARY_SENSOR.
+PRIMARY_SENSOR = 0
+SENSOR_COLORS = (GREEN, (255, 200, 0), (0, 200, 255), (255, 100, 255))
+
+class SensorTrack:
+    def __init__(self):
+        self.dist_hist = deque(maxlen=MAP_SMOOTH_N)
+        self.yaw_hist = deque(maxlen=MAP_SMOOTH_N)
+        self.map = ScanMap(SCAN_RESOLUTION)
+        self.state = {
+            "distance_raw": 0.0,
+            "yaw_raw": 90.0,
+            "yaw_instant": 90.0,
+            "direction": "Stationary",
+            "object": "None",
+            "gyro": "Still",
+            "strength": 0,
+            "temp": 0.0,
+        }
+
+tracks = {PRIMARY_SENSOR: SensorTrack()}
+sensor = tracks[PRIMARY_SENSOR].state
 
-distance_plot = 0.0
 beam_distance = 0.0
 calibrated = False
 yaw_offset = 0.0
-# Enhanced scan_points structure
-scan_points = {}  # angle -> {'coord': (x,y), 'has_object': bool, 'distance': float}
+# Pixels per cm along each bin's direction, so drawing a bin is a multiply.
+# All maps have the same bins and share the tables.
+bin_map = tracks[PRIMARY_SENSOR].map
+bin_dx = [SCALE * math.cos(math.radians(bin_map.angle(i))) for i in range(bin_map.bins)]
+bin_dy = [-SCALE * math.sin(math.radians(bin_map.angle(i))) for i in range(bin_map.bins)]
+
+# Ingest throughput (text vs binary telemetry), fed from the reader thread
+link_rate = {"samples": 0.0, "bytes": 0.0}
+rate_window = {"start": time.time(), "samples": 0, "bytes": 0}
+bytes_seen = 0
+device_stats = {}  # latest "type=stats" record from the firmware
+loop_stats = {}  # latest "type=loop" record: loop rate, task deadline misses
+
+# Host pipeline stats: S toggles the overlay, --stats-dump logs them
+host_stats = HostStats()
+show_stats = False
+stats_dump = StatsDump(args.stats_dump) if args.stats_dump else None
+STATS_DUMP_S = 1.0
+last_dump = time.time()
 
 # UI Layout
 PANEL_WIDTH = 320
 PANEL_X = WIDTH - PANEL_WIDTH - 20
 PANEL_Y = 20
-CARD_HEIGHT = 140
+CARD_HEIGHT = 150
 SPACING = 15
 
 # ===== HELPERS =====
@@ -132,13 +257,15 @@ def wrap360(a):
     while a >= 360: a -= 360
     return a
 
-def parse_line(line):
-    out = {}
-    for part in line.split(","):
-        if "=" in part:
-            k, v = part.split("=", 1)
-            out[k.strip().lower()] = v.strip()
-    return out
+def update_link_rate(samples, nbytes):
+    rate_window["samples"] += samples
+    rate_window["bytes"] += nbytes
+    now = time.time()
+    elapsed = now - rate_window["start"]
+    if elapsed >= 1.0:
+        link_rate["samples"] = rate_window["samples"] / elapsed
+        link_rate["bytes"] = rate_window["bytes"] / elapsed
+        rate_window.update(start=now, samples=0, bytes=0)
 
 def get_beam_angle(yaw_raw):
     y = yaw_raw - yaw_offset if calibrated else yaw_raw
@@ -148,12 +275,12 @@ def get_beam_angle(yaw_raw):
         return movavg(beam_yaw_hist, reversed_y)
     return None
 
-def get_map_angle(yaw_raw):
+def get_map_angle(yaw_raw, yaw_hist):
     y = yaw_raw - yaw_offset if calibrated else yaw_raw
     y = wrap360(y)
     if 0.0 <= y <= 180.0:
         reversed_y = 180 - y
-        return movavg(map_yaw_hist, reversed_y)
+        return movavg(yaw_hist, reversed_y)
     return None
 
 def polar_to_xy(angle_deg, dist_cm):
@@ -163,6 +290,67 @@ def polar_to_xy(angle_deg, dist_cm):
     y = CENTER_Y - r * math.sin(a)
     return (int(x), int(y))
 
+# Text surfaces by (font, text, color): a label is only re-rendered when its
+# text changes. Cleared when it grows past TEXT_CACHE_MAX (changing values
+# keep adding entries).
+text_cache = {}
+TEXT_CACHE_MAX = 512
+
+def render_text(font, text, color):
+    key = (id(font), text, color)
+    surf = text_cache.get(key)
+    if surf is None:
+        if len(text_cache) >= TEXT_CACHE_MAX:
+            text_cache.clear()
+        surf = text_cache[key] = font.render(text, True, color)
+    return surf
+
+# Static radar grid and labels, rendered once per window size and blitted
+# every frame
+background_cache = {"size": None, "surface": None}
+
+def radar_background():
+    size = screen.get_size()
+    if background_cache["size"] != size:
+        surface = pygame.Surface(size).convert()
+        surface.fill(BLACK)
+        draw_radar_display(surface)
+        background_cache.update(size=size, surface=surface)
+    return background_cache["surface"]
+
+def set_minimized(value):
+    global minimized, screen
+    minimized = value
+    screen = pygame.display.set_mode((MINI_WIDTH, MINI_HEIGHT) if minimized else (WIDTH, HEIGHT))
+    background_cache["size"] = None
+
+def sector_rect(a0, a1, radius_cm, pad):
+    """Screen rect covering the radar sector between two angles."""
+    points = [(CENTER_X, CENTER_Y), polar_to_xy(a0, radius_cm), polar_to_xy(a1, radius_cm)]
+    if a0 < 90 < a1:
+        points.append(polar_to_xy(90, radius_cm))
+    xs = [p[0] for p in points]
+    ys = [p[1] for p in points]
+    return pygame.Rect(min(xs), min(ys), max(xs) - min(xs) + 1, max(ys) - min(ys) + 1).inflate(pad, pad)
+
+def scan_dirty_rect(scan_map, touched):
+    """Sector of the touched bins and their filled neighbours, whose
+    polyline segments moved too."""
+    lo, hi = touched
+    filled = scan_map.filled()
+    before = bisect_left(filled, lo) - 1
+    after = bisect_right(filled, hi)
+    a0 = scan_map.angle(filled[before] if before >= 0 else lo)
+    a1 = scan_map.angle(filled[after] if after < len(filled) else hi)
+    return sector_rect(a0, a1, MAX_CM, 6)
+
+def beam_dirty_rect(old, new):
+    # Beam line plus the target marker at its end
+    angles = [beam[0] for beam in (old, new) if beam[0] is not None]
+    if not angles:
+        return None
+    return sector_rect(min(angles), max(angles), MAX_CM, 30)
+
 def draw_card(surface, x, y, w, h, title, content, title_color=WHITE, bg_color=(25, 25, 25)):
     # Card background
     card_rect = pygame.Rect(x, y, w, h)
@@ -170,20 +358,20 @@ def draw_card(surface, x, y, w, h, title, content, title_color=WHITE, bg_color=(
     pygame.draw.rect(surface, (70, 70, 70), card_rect, 2, border_radius=12)
     
     # Title
-    title_surf = font_medium.render(title, True, title_color)
+    title_surf = render_text(font_medium, title, title_color)
     surface.blit(title_surf, (x + 15, y + 12))
     
     # Content
     content_y = y + 40
     for line in content:
-        text_surf = font_small.render(line, True, WHITE)
+        text_surf = render_text(font_small, line, WHITE)
         surface.blit(text_surf, (x + 15, content_y))
         content_y += 22
 
-def draw_radar_display():
+def draw_radar_display(surface):
     # Arc background (outer boundary)
     pygame.draw.arc(
-        screen,
+        surface,
         (15, 15, 15),
         pygame.Rect(
             CENTER_X - (MAX_CM * SCALE + 10),
@@ -198,7 +386,7 @@ def draw_radar_display():
 
     # Outer arc border
     pygame.draw.arc(
-        screen,
+        surface,
         GRAY,
         pygame.Rect(
             CENTER_X - MAX_CM * SCALE,
@@ -214,7 +402,7 @@ def draw_radar_display():
     # Range rings (half-circles)
     for r in [10, 20, 30, 40, 50, 60]:
         pygame.draw.arc(
-            screen,
+            surface,
             DARK_GRAY,
             pygame.Rect(CENTER_X - r * SCALE, CENTER_Y - r * SCALE, r * SCALE * 2, r * SCALE * 2),
             math.radians(0),
@@ -227,64 +415,33 @@ def draw_radar_display():
         end_pos = polar_to_xy(angle, MAX_CM)
         color = LIGHT_GRAY if angle == 90 else DARK_GRAY
         width = 2 if angle == 90 else 1
-        pygame.draw.line(screen, color, (CENTER_X, CENTER_Y), end_pos, width)
+        pygame.draw.line(surface, color, (CENTER_X, CENTER_Y), end_pos, width)
 
     # Range labels (on the middle vertical line)
     for r in [10, 20, 30, 40, 50, 60, 70]:
         label_pos = polar_to_xy(90, r)
         label = font_small.render(f"{r}cm", True, LIGHT_GRAY)
-        screen.blit(label, (label_pos[0] - 15, label_pos[1] - 10))
+        surface.blit(label, (label_pos[0] - 15, label_pos[1] - 10))
 
     # Angle labels (top arc only)
     for angle in [0, 30, 60, 90, 120, 150, 180]:
         label_pos = polar_to_xy(angle, MAX_CM + 15)
         label = font_small.render(f"{angle}°", True, LIGHT_GRAY)
         label_rect = label.get_rect(center=label_pos)
-        screen.blit(label, label_rect)
+        surface.blit(label, label_rect)
 
 def draw_scan_data():
-    if not scan_points:
-        return
-    
-    # Draw continuous dotted line connecting all scan points
-    all_angles = sorted(scan_points.keys())
-    if len(all_angles) > 1:
-        # Create a smooth dotted line across all scanned angles
-        for i in range(len(all_angles) - 1):
-            angle1 = all_angles[i]
-            angle2 = all_angles[i + 1]
-            
-            # Get coordinates for both points
-            data1 = scan_points[angle1]
-            data2 = scan_points[angle2]
-            
-            # Use detection coordinates if available, otherwise use max range
-            coord1 = data1['coord'] if data1['has_object'] else polar_to_xy(angle1, MAX_CM)
-            coord2 = data2['coord'] if data2['has_object'] else polar_to_xy(angle2, MAX_CM)
-            
-            # Draw fine dotted line between consecutive points with no gaps
-            draw_dotted_line(coord1, coord2, GREEN, dot_size=1, spacing=2)
-
-def draw_dotted_line(start_pos, end_pos, color, dot_size=1, spacing=2):
-    """Draw a fine dotted line with no gaps between two points"""
-    start_x, start_y = start_pos
-    end_x, end_y = end_pos
-    
-    # Calculate distance and direction
-    dx = end_x - start_x
-    dy = end_y - start_y
-    distance = math.sqrt(dx*dx + dy*dy)
-    
-    if distance == 0:
-        return
-    
-    # Draw very fine dots with minimal spacing for continuous appearance
-    num_dots = int(distance / spacing) + 1
-    for i in range(num_dots + 1):
-        progress = i / max(num_dots, 1) if num_dots > 0 else 0
-        dot_x = start_x + progress * dx
-        dot_y = start_y + progress * dy
-        pygame.draw.circle(screen, color, (int(dot_x), int(dot_y)), dot_size)
+    # One polyline per sensor through all its scanned bins; without an object
+    # a bin sits at max range (its stored distance is MAX_CM). The cost is per
+    # bin, not per pixel of line.
+    for sensor_id, t in sorted(tracks.items()):
+        filled = t.map.filled()
+        if len(filled) < 2:
+            continue
+        distance = t.map.distance
+        points = [(CENTER_X + distance[i] * bin_dx[i], CENTER_Y + distance[i] * bin_dy[i])
+                  for i in filled]
+        pygame.draw.lines(screen, SENSOR_COLORS[sensor_id % len(SENSOR_COLORS)], False, points, 2)
 
 def draw_beam(angle_deg, dist_cm):
     if angle_deg is None:
@@ -311,7 +468,7 @@ def draw_ui():
         # Minimized UI - compact display
         # Mini title bar
         pygame.draw.rect(screen, (40, 40, 40), (0, 0, MINI_WIDTH, 30), border_radius=8)
-        title = font_medium.render("Radar (Minimized)", True, WHITE)
+        title = render_text(font_medium, "Radar (Minimized)", WHITE)
         screen.blit(title, (10, 6))
         
         # Minimize button (expand)
@@ -335,7 +492,7 @@ def draw_ui():
             color = GREEN if "CAL" in line and calibrated else color
             color = RED if "UNCAL" in line else color
             
-            text = font_small.render(line, True, color)
+            text = render_text(font_small, line, color)
             screen.blit(text, (15, y_pos))
             y_pos += 20
             
@@ -346,14 +503,18 @@ def draw_ui():
         minimize_btn = pygame.Rect(WIDTH - 60, 10, 50, 25)
         pygame.draw.rect(screen, (60, 60, 60), minimize_btn, border_radius=6)
         pygame.draw.rect(screen, (100, 100, 100), minimize_btn, 2, border_radius=6)
-        min_text = font_small.render("MIN", True, WHITE)
+        min_text = render_text(font_small, "MIN", WHITE)
         screen.blit(min_text, (minimize_btn.x + 12, minimize_btn.y + 4))
         
         # Status panel
         status_content = [
-            f"Distance: {beam_distance:.1f} cm",
+            # lidar_hz is summed over all units on the device
+            f"Distance: {beam_distance:.1f} cm  (LiDAR {'total ' if len(tracks) > 1 else ''}"
+            f"{device_stats.get('lidar_hz', 0)} Hz)",
             f"Angle: {get_beam_angle(sensor['yaw_instant']):.1f}°" if get_beam_angle(sensor['yaw_instant']) else "Angle: —",
-            f"Object: {sensor['object']}"
+            f"Object: {sensor['object']}",
+            f"Signal: {sensor['strength']}, {float(sensor['temp']):.1f} °C",
+            f"Ingest: {link_rate['samples']:.0f} samples/s, {link_rate['bytes']:.0f} B/s"
         ]
         object_color = RED if sensor["object"].lower() != "none" else WHITE
         draw_card(screen, PANEL_X, PANEL_Y, PANEL_WIDTH, CARD_HEIGHT, 
@@ -363,8 +524,14 @@ def draw_ui():
         system_content = [
             f"Calibrated: {'YES' if calibrated else 'NO'}",
             f"Direction: {sensor['direction']}",
-            f"Gyro: {sensor['gyro']}",
-            f"Points: {len(scan_points)}"
+            f"Gyro: {sensor['gyro']}  (I2C {device_stats.get('i2c_us_avg', 0)}/"
+            f"{device_stats.get('i2c_us_max', 0)} us)",
+            "Points: " + "/".join(str(t.map.count) for _, t in sorted(tracks.items())) +
+            f", dropped {reader.dropped}" + (
+                f"  (loop {loop_stats.get('loops_per_s', 0)}/s)" if loop_stats else ""),
+            "LiDAR ok/bad/resync/ovf: " + "/".join(
+                str(device_stats.get(k, 0))
+                for k in ("frames_ok", "checksum_errors", "resyncs", "rx_overflows"))
         ]
         calib_color = GREEN if calibrated else RED
         draw_card(screen, PANEL_X, PANEL_Y + CARD_HEIGHT + SPACING, PANEL_WIDTH, CARD_HEIGHT,
@@ -375,31 +542,50 @@ def draw_ui():
             "R - Reset scan data",
             "C - Calibrate sensor",
             "M - Minimize window", 
+            "E - Eco redraw " + ("on" if ECO_REDRAW else "off") + ", S - Stats",
             "Q - Quit application"
         ]
         draw_card(screen, PANEL_X, PANEL_Y + 2*(CARD_HEIGHT + SPACING), PANEL_WIDTH, CARD_HEIGHT,
                   "CONTROLS", controls_content, BLUE)
         
         # Title
-        title = font_large.render("OBJECT SCANNER", True, WHITE)
+        title = render_text(font_large, "OBJECT SCANNER", WHITE)
         screen.blit(title, (30, 30))
         
         # Range indicator
-        range_text = font_medium.render(f"MAX RANGE: {MAX_CM}cm", True, LIGHT_GRAY)
+        range_text = render_text(font_medium, f"MAX RANGE: {MAX_CM}cm", LIGHT_GRAY)
         screen.blit(range_text, (30, 70))
         
+        # Host pipeline overlay
+        if show_stats:
+            draw_card(screen, STATS_RECT.x, STATS_RECT.y, STATS_RECT.w, STATS_RECT.h,
+                      "HOST PIPELINE", host_stats.overlay_lines(host_stats.snapshot(link_rate, reader)),
+                      BLUE)
+
         return minimize_btn
 
 # ===== MAIN LOOP =====
+# With ECO_REDRAW a frame is only drawn when a sample or an input event came
+# in, and only the changed rects (beam sector, touched bins, status cards)
+# are redrawn and pushed to the display.
+STATUS_RECT = pygame.Rect(PANEL_X, PANEL_Y, PANEL_WIDTH, 2 * CARD_HEIGHT + SPACING)
+STATS_RECT = pygame.Rect(30, HEIGHT - CARD_HEIGHT - 20, 440, CARD_HEIGHT)
+drawn_beam = (None, 0.0)
 running = True
 while running:
+    frame_start = time.perf_counter()
+
     # Events
+    full_redraw = not ECO_REDRAW
     for e in pygame.event.get():
+        if e.type != pygame.MOUSEMOTION:
+            full_redraw = True
         if e.type == pygame.QUIT:
             running = False
         elif e.type == pygame.KEYDOWN:
             if e.key == pygame.K_r:
-                scan_points.clear()
+                for t in tracks.values():
+                    t.map.clear()
             elif e.key == pygame.K_c:
                 yaw_offset = sensor["yaw_instant"] - 90.0
                 calibrated = True
@@ -409,79 +595,139 @@ while running:
             elif e.key == pygame.K_q:
                 running = False
             elif e.key == pygame.K_m:
-                minimized = not minimized
-                if minimized:
-                    screen = pygame.display.set_mode((MINI_WIDTH, MINI_HEIGHT))
-                else:
-                    screen = pygame.display.set_mode((WIDTH, HEIGHT))
+                set_minimized(not minimized)
+            elif e.key == pygame.K_e:
+                ECO_REDRAW = not ECO_REDRAW
+            elif e.key == pygame.K_s:
+                show_stats = not show_stats
         elif e.type == pygame.MOUSEBUTTONDOWN:
             # Handle minimize/maximize button clicks
             if minimized:
                 expand_btn = pygame.Rect(MINI_WIDTH - 35, 5, 25, 20)
                 if expand_btn.collidepoint(e.pos):
-                    minimized = False
-                    screen = pygame.display.set_mode((WIDTH, HEIGHT))
+                    set_minimized(False)
             else:
                 minimize_btn = pygame.Rect(WIDTH - 60, 10, 50, 25)
                 if minimize_btn.collidepoint(e.pos):
-                    minimized = True
-                    screen = pygame.display.set_mode((MINI_WIDTH, MINI_HEIGHT))
+                    set_minimized(True)
+
+    # Serial ingest: apply every record the reader thread decoded since the
+    # last frame
+    samples = 0
+    records = reader.drain()
+    drain_time = time.perf_counter()
+    for parsed in records:
+        if parsed.get("type") == "stats":
+            device_stats.update(parsed)
+            continue
+        if parsed.get("type") == "loop":
+            loop_stats.update(parsed)
+            continue
+        if parsed.get("type") == "ack":
+            print(f"Device {parsed.get('cmd')}: {'ok' if parsed.get('ok') == '1' else 'rejected'}")
+            continue
+        if parsed.get("type") == "hello":
+            continue
 
-    # Serial read
-    if ser.in_waiting:
         try:
-            line = ser.readline().decode("utf-8", errors="ignore").strip()
-            if line:
-                parsed = parse_line(line)
-                
-                if "distance" in parsed:
-                    raw_dist = float(parsed["distance"])
-                    sensor["distance_raw"] = movavg(map_dist_hist, raw_dist)
+            sensor_id = int(parsed.get("sensor", PRIMARY_SENSOR))
+        except ValueError:
+            continue
+        t = tracks.get(sensor_id)
+        if t is None:
+            t = tracks[sensor_id] = SensorTrack()
+        state = t.state
+
+        try:
+            if "distance" in parsed:
+                samples += 1
+                host_stats.sample(parsed, drain_time)
+                raw_dist = float(parsed["distance"])
+                state["distance_raw"] = movavg(t.dist_hist, raw_dist)
+                if sensor_id == PRIMARY_SENSOR:
                     beam_distance = raw_dist
-                
-                if "yaw" in parsed:
-                    raw_yaw = wrap360(float(parsed["yaw"]))
-                    sensor["yaw_instant"] = raw_yaw
-                    sensor["yaw_raw"] = raw_yaw
-                
-                if "direction" in parsed: sensor["direction"] = parsed["direction"]
-                if "object" in parsed: sensor["object"] = parsed["object"]
-                if "gyro" in parsed: sensor["gyro"] = parsed["gyro"]
-        except: pass
+
+            if "yaw" in parsed:
+                raw_yaw = wrap360(float(parsed["yaw"]))
+                state["yaw_instant"] = raw_yaw
+                state["yaw_raw"] = raw_yaw
+        except ValueError:
+            continue
+
+        if "direction" in parsed: state["direction"] = parsed["direction"]
+        if "object" in parsed: state["object"] = parsed["object"]
+        if "gyro" in parsed: state["gyro"] = parsed["gyro"]
+        if "strength" in parsed: state["strength"] = parsed["strength"]
+        if "temp" in parsed: state["temp"] = parsed["temp"]
+
+        # Update the sensor's map, once per sample
+        map_angle = get_map_angle(state["yaw_raw"], t.yaw_hist)
+        if map_angle is not None and 0 <= map_angle <= 180:
+            has_object = state["object"].lower() != "none" and state["distance_raw"] < MAX_CM
+            actual_distance = clamp(state["distance_raw"], 0.0, MAX_CM) if has_object else MAX_CM
+            t.map.update(map_angle, actual_distance, has_object)
+    update_link_rate(samples, reader.decoder.bytes_in - bytes_seen)
+    bytes_seen = reader.decoder.bytes_in
+    if stats_dump and time.time() - last_dump >= STATS_DUMP_S:
+        last_dump = time.time()
+        stats_dump.write(host_stats.snapshot(link_rate, reader))
 
     # Calculate angles
     beam_angle = get_beam_angle(sensor["yaw_instant"])
-    map_angle = get_map_angle(sensor["yaw_raw"])
-    
+
     # Calculate distances
     beam_plot_distance = clamp(beam_distance, 0.0, MAX_CM) if sensor["object"].lower() != "none" and beam_distance < MAX_CM else MAX_CM
-    distance_plot = clamp(sensor["distance_raw"], 0.0, MAX_CM) if sensor["object"].lower() != "none" and sensor["distance_raw"] < MAX_CM else MAX_CM
-
-    # Update map (Enhanced version)
-    if map_angle is not None and 0 <= map_angle <= 180:
-        angle_key = int(round(map_angle))
-        has_object = sensor["object"].lower() != "none" and sensor["distance_raw"] < MAX_CM
-        actual_distance = sensor["distance_raw"] if has_object else MAX_CM
-        
-        scan_points[angle_key] = {
-            'coord': polar_to_xy(angle_key, distance_plot),
-            'has_object': has_object,
-            'distance': actual_distance
-        }
 
     # Draw everything
-    screen.fill(BLACK)
-    
-    if not minimized:
-        draw_radar_display()
+    beam = (beam_angle, beam_plot_distance)
+    if full_redraw or minimized:
+        rects = None
+        if not full_redraw and not records:
+            clock.tick(60)
+            continue
+    else:
+        rects = []
+        for t in tracks.values():
+            touched = t.map.take_touched()
+            if touched:
+                rects.append(scan_dirty_rect(t.map, touched))
+        if beam != drawn_beam:
+            rect = beam_dirty_rect(drawn_beam, beam)
+            if rect:
+                rects.append(rect)
+        if records:
+            rects.append(STATUS_RECT)
+            if show_stats:
+                rects.append(STATS_RECT)
+        if not rects:
+            clock.tick(60)
+            continue
+        screen.set_clip(rects[0].unionall(rects[1:]))
+    if rects is None:
+        for t in tracks.values():
+            t.map.take_touched()
+
+    if minimized:
+        screen.fill(BLACK)
+    else:
+        screen.blit(radar_background(), (0, 0))
         draw_scan_data()
         if beam_angle is not None:
             draw_beam(beam_angle, beam_plot_distance)
     
     draw_ui()
+    drawn_beam = beam
 
-    pygame.display.flip()
+    if rects is None:
+        pygame.display.flip()
+    else:
+        screen.set_clip(None)
+        pygame.display.update(rects)
+    host_stats.frame(frame_start, time.perf_counter())
     clock.tick(60)
 
+reader.stop()
+if stats_dump:
+    stats_dump.close()
 ser.close()
 pygame.quit()
\ No newline at end of file
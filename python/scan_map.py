@@ -0,0 +1,55 @@
+"""Fixed-resolution scan map for the radar view.
+
+The half circle is split into bins of `resolution` degrees, stored as
+preallocated parallel columns (distance, object flag, time of last update).
+A sample lands in its bin in O(1), and iterating the bins is already in
+angle order, so drawing never sorts.
+"""
+import time
+from array import array
+
+
+class ScanMap:
+    def __init__(self, resolution=0.25, span=180.0):
+        self.resolution = resolution
+        self.bins = int(round(span / resolution)) + 1
+        self.distance = array("f", bytes(4 * self.bins))   # cm, MAX_CM without object
+        self.has_object = bytearray(self.bins)
+        self.updated = array("d", bytes(8 * self.bins))    # time.monotonic(), 0 = empty
+        self.count = 0                                     # bins filled
+        self.touched = None                                # (lo, hi) bins since take_touched()
+
+    def angle(self, index):
+        return index * self.resolution
+
+    def update(self, angle, distance, has_object, now=None):
+        index = int(round(angle / self.resolution))
+        if not 0 <= index < self.bins:
+            return
+        if not self.updated[index]:
+            self.count += 1
+        self.distance[index] = distance
+        self.has_object[index] = has_object
+        self.updated[index] = now if now is not None else time.monotonic()
+        if self.touched is None:
+            self.touched = (index, index)
+        else:
+            lo, hi = self.touched
+            self.touched = (min(lo, index), max(hi, index))
+
+    def take_touched(self):
+        """Range of bins updated since the last call, or None."""
+        touched, self.touched = self.touched, None
+        return touched
+
+    def filled(self):
+        """Indices of the bins seen so far, in angle order."""
+        updated = self.updated
+        return [i for i in range(self.bins) if updated[i]]
+
+    def clear(self):
+        self.distance = array("f", bytes(4 * self.bins))
+        self.has_object = bytearray(self.bins)
+        self.updated = array("d", bytes(8 * self.bins))
+        self.count = 0
+        self.touched = None
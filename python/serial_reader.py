@@ -0,0 +1,61 @@
+"""Background serial ingest for the host tools.
+
+SerialReader reads whatever the port has buffered, decodes it with
+StreamDecoder and appends every record to a bounded deque. deque append and
+popleft are atomic in CPython, so the render loop drains it without a lock.
+When the consumer falls behind, the oldest records are dropped (and counted)
+instead of the OS buffer backing up and latency growing.
+
+ser can be anything with pyserial's in_waiting/read(), such as a
+stream_log.ReplaySource. Given a recorder (stream_log.StreamRecorder), every
+raw read is also logged before it is decoded.
+"""
+import threading
+from collections import deque
+
+from telemetry import StreamDecoder
+
+QUEUE_MAX = 4096
+
+
+class SerialReader(threading.Thread):
+    def __init__(self, ser, maxlen=QUEUE_MAX, recorder=None):
+        super().__init__(daemon=True)
+        self.ser = ser
+        self.recorder = recorder
+        self.decoder = StreamDecoder()
+        self.records = deque(maxlen=maxlen)
+        self.received = 0  # records decoded
+        self.dropped = 0   # records pushed out of the full queue
+        self.error = None
+        self._stopping = threading.Event()
+
+    def run(self):
+        records = self.records
+        while not self._stopping.is_set():
+            try:
+                data = self.ser.read(max(1, self.ser.in_waiting))
+            except OSError as e:  # serial.SerialException included
+                self.error = e
+                print(f"Serial read failed: {e}")
+                break
+            if not data:
+                continue
+            if self.recorder:
+                self.recorder.write(data)
+            for record in self.decoder.feed(data):
+                if len(records) == records.maxlen:
+                    self.dropped += 1
+                records.append(record)
+                self.received += 1
+
+    def drain(self):
+        """Every record queued so far, oldest first."""
+        records = self.records
+        return [records.popleft() for _ in range(len(records))]
+
+    def stop(self):
+        self._stopping.set()
+        self.join(timeout=1.0)
+        if self.recorder:
+            self.recorder.close()
@@ -0,0 +1,198 @@
+"""Recording and replay of the raw serial stream.
+
+A log keeps every read from the port as it arrived, so replaying it feeds
+StreamDecoder exactly the bytes (and the garbage) the live link delivered:
+
+    header   "OSLG" | version u16 | reserved u16
+    record   t_us u64 (since recording started) | len u16 | data[len]
+    ...
+    index    (offset u64, t_us u64) of the first record of every block
+    trailer  index offset u64 | entries u32 | "OSIX"
+
+A block starts at least every INDEX_BYTES bytes or INDEX_US microseconds,
+so a reader can seek to a time with a binary search of the index and then
+at most one block of scanning. Everything is little-endian. A log that was
+never closed has no trailer and is indexed by scanning it on open.
+"""
+import mmap
+import struct
+import time
+from bisect import bisect_right
+
+MAGIC = b"OSLG"
+INDEX_MAGIC = b"OSIX"
+VERSION = 1
+HEADER = struct.Struct("<4sHH")
+RECORD = struct.Struct("<QH")
+INDEX_ENTRY = struct.Struct("<QQ")
+TRAILER = struct.Struct("<QI4s")
+INDEX_BYTES = 64 * 1024
+INDEX_US = 1000000
+MAX_RECORD = 0xFFFF
+
+
+class StreamRecorder:
+    """Appends timestamped raw reads to a log file."""
+
+    def __init__(self, path):
+        self.file = open(path, "wb")
+        self.file.write(HEADER.pack(MAGIC, VERSION, 0))
+        self.start = time.perf_counter()
+        self.offset = HEADER.size
+        self.index = []
+        self.block_offset = None
+        self.block_us = 0
+
+    def write(self, data):
+        t_us = int((time.perf_counter() - self.start) * 1e6)
+        for pos in range(0, len(data), MAX_RECORD):
+            chunk = data[pos:pos + MAX_RECORD]
+            if (self.block_offset is None or self.offset - self.block_offset >= INDEX_BYTES
+                    or t_us - self.block_us >= INDEX_US):
+                self.index.append((self.offset, t_us))
+                self.block_offset = self.offset
+                self.block_us = t_us
+            self.file.write(RECORD.pack(t_us, len(chunk)))
+            self.file.write(chunk)
+            self.offset += RECORD.size + len(chunk)
+
+    def close(self):
+        if self.file.closed:
+            return
+        for entry in self.index:
+            self.file.write(INDEX_ENTRY.pack(*entry))
+        self.file.write(TRAILER.pack(self.offset, len(self.index), INDEX_MAGIC))
+        self.file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+class StreamLog:
+    """Memory-mapped read access to a log written by StreamRecorder."""
+
+    def __init__(self, path):
+        self.file = open(path, "rb")
+        self.map = mmap.mmap(self.file.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version, _ = HEADER.unpack_from(self.map, 0)
+        if magic != MAGIC or version != VERSION:
+            raise ValueError(f"{path}: not a stream log")
+        self.end, self.index = self._read_index()
+        self.index_us = [t_us for _, t_us in self.index]
+
+    def _read_index(self):
+        size = len(self.map)
+        if size >= HEADER.size + TRAILER.size:
+            offset, count, magic = TRAILER.unpack_from(self.map, size - TRAILER.size)
+            if magic == INDEX_MAGIC and offset + count * INDEX_ENTRY.size + TRAILER.size == size:
+                return offset, [INDEX_ENTRY.unpack_from(self.map, offset + i * INDEX_ENTRY.size)
+                                for i in range(count)]
+        # Unclosed log: index every record, dropping a torn last one
+        index = []
+        pos = HEADER.size
+        while pos + RECORD.size <= size:
+            t_us, length = RECORD.unpack_from(self.map, pos)
+            if pos + RECORD.size + length > size:
+                break
+            index.append((pos, t_us))
+            pos += RECORD.size + length
+        return pos, index
+
+    @property
+    def duration_us(self):
+        """t_us of the last record, found by scanning its index block."""
+        if not self.index:
+            return 0
+        pos = self.index[-1][0]
+        t_us = self.index[-1][1]
+        while pos < self.end:
+            t_us, length = RECORD.unpack_from(self.map, pos)
+            pos += RECORD.size + length
+        return t_us
+
+    def records(self, start_us=0):
+        """(t_us, data) of every read from start_us on; data is a memoryview
+        into the map, valid until close()."""
+        block = max(bisect_right(self.index_us, start_us) - 1, 0)
+        pos = self.index[block][0] if self.index else self.end
+        view = memoryview(self.map)
+        try:
+            while pos < self.end:
+                t_us, length = RECORD.unpack_from(self.map, pos)
+                pos += RECORD.size
+                if t_us >= start_us:
+                    yield t_us, view[pos:pos + length]
+                pos += length
+        finally:
+            # An exported view keeps the map from closing
+            view.release()
+
+    def close(self):
+        self.map.close()
+        self.file.close()
+
+
+class ReplaySource:
+    """Stands in for serial.Serial and plays a log back.
+
+    speed 1.0 is real time, larger values are faster, and 0 delivers
+    everything as fast as it is read. Commands written to it are dropped.
+    """
+
+    def __init__(self, path, speed=1.0, timeout=0.05):
+        self.log = StreamLog(path)
+        self.port = path
+        self.baudrate = 0
+        self.speed = speed
+        self.timeout = timeout
+        self.eof = False
+        self._records = self.log.records()
+        self._pending = b""
+        self._due = 0.0
+        self._start = time.perf_counter()
+        self._next()
+
+    def _next(self):
+        try:
+            t_us, data = next(self._records)
+        except StopIteration:
+            self.eof = True
+            self._pending = b""
+            return
+        self._pending = bytes(data)
+        self._due = self._start + t_us / 1e6 / self.speed if self.speed else 0.0
+
+    @property
+    def in_waiting(self):
+        if self._pending and time.perf_counter() >= self._due:
+            return len(self._pending)
+        return 0
+
+    def read(self, size=1):
+        if not self._pending:
+            time.sleep(self.timeout)
+            return b""
+        wait = self._due - time.perf_counter()
+        if wait > 0:
+            time.sleep(min(wait, self.timeout))
+            if wait > self.timeout:
+                return b""
+        data, self._pending = self._pending[:size], self._pending[size:]
+        if not self._pending:
+            self._next()
+        return data
+
+    def write(self, data):
+        return len(data)
+
+    def reset_input_buffer(self):
+        pass
+
+    def close(self):
+        self._records.close()
+        self._records = iter(())
+        self._pending = b""
+        self.log.close()
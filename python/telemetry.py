@@ -0,0 +1,236 @@
+"""Host side of the firmware telemetry protocol (see include/telemetry.h).
+
+The firmware sends either key=value text lines or binary frames:
+
+    A5 5A | type | len | payload[len] | crc16 (LE, CRC-16/CCITT-FALSE)
+
+StreamDecoder accepts both on the same byte stream, so switching the
+firmware's protocol does not need a host restart.
+"""
+import binascii
+import re
+import struct
+
+SYNC = b"\xa5\x5a"
+FRAME_OVERHEAD = 6
+
+FRAME_SAMPLE = 0x01
+FRAME_STATS = 0x02
+FRAME_LOOP_STATS = 0x03
+
+STATUS_OBJECT = 0x01
+STATUS_MOVING = 0x02
+STATUS_DIR_RIGHT = 0x04
+STATUS_DIR_LEFT = 0x08
+# Bits 4..6: the LiDAR unit the sample came from
+STATUS_SENSOR_SHIFT = 4
+STATUS_SENSOR_MASK = 0x70
+
+# seq, t_us, distance, yaw (centidegrees), status, strength, temp (0.1 °C)
+SAMPLE_FORMAT = "<HIHHBHh"
+SAMPLE_STRUCT = struct.Struct(SAMPLE_FORMAT)
+SAMPLE_SIZE = SAMPLE_STRUCT.size
+
+# Text sample lines as telemetryFormatSample() writes them; anything else
+# (stats, acks, older firmware) goes through parse_line().
+SAMPLE_LINE = re.compile(
+    rb"distance=(\d+),yaw=([\d.]+),direction=(\w+),object=(\w+),gyro=(\w+)"
+    rb"(?:,t_us=(\d+))?(?:,strength=(\d+))?(?:,temp=(-?[\d.]+))?(?:,sensor=(\d+))?\r?$")
+
+# Counters in a stats frame, in payload order (TelemetryStats in telemetry.h,
+# STAT_NAMES in telemetry.cpp).
+# Text mode sends the same names as keys of "type=stats" lines; a record is
+# split over several lines of whole fields, so merge them by type.
+STATS_FIELDS = ("frames_ok", "checksum_errors", "resyncs", "rx_overflows",
+                "rx_high_water", "imu_fifo_overflows", "i2c_us_avg", "i2c_us_max",
+                "samples_sent", "lidar_hz", "lidar_responses", "weak_frames",
+                "bias_updates", "tx_drops", "tx_high_water")
+
+# Loop frame (TelemetryLoopStats): loop rate, min/avg/max microseconds of
+# each loop() stage (LOOP_STATS firmware builds, zero otherwise), then the
+# scheduler's deadline misses per task. Text mode sends "type=loop" lines
+# with these keys, split the same way.
+LOOP_FIELDS = ("loops_per_s",) + tuple(
+    "%s_%s" % (stage, stat)
+    for stage in ("imu", "lidar", "tx", "cmd")
+    for stat in ("min", "avg", "max")) + (
+    "imu_misses", "imu_late_max", "lidar_misses", "host_misses")
+
+MAX_LINE = 256
+
+
+def parse_line(line):
+    out = {}
+    for part in line.split(","):
+        if "=" in part:
+            k, v = part.split("=", 1)
+            out[k.strip().lower()] = v.strip()
+    return out
+
+
+def decode_text_sample(match):
+    """Typed sample dict from a SAMPLE_LINE match, same keys as decode_sample()."""
+    dist, yaw, direction, obj, gyro, t_us, strength, temp, sensor = match.groups()
+    out = {
+        "sensor": int(sensor) if sensor is not None else 0,
+        "distance": int(dist),
+        "yaw": float(yaw),
+        "direction": direction.decode(),
+        "object": obj.decode(),
+        "gyro": gyro.decode(),
+    }
+    if t_us is not None:
+        out["t_us"] = int(t_us)
+    if strength is not None:
+        out["strength"] = int(strength)
+    if temp is not None:
+        out["temp"] = float(temp)
+    return out
+
+
+def decode_line(line):
+    match = SAMPLE_LINE.match(line)
+    if match:
+        return decode_text_sample(match)
+    return parse_line(line.decode("utf-8", errors="ignore"))
+
+
+def decode_sample(payload):
+    seq, t_us, dist, yaw_cd, status, strength, temp = SAMPLE_STRUCT.unpack_from(payload)
+    if status & STATUS_DIR_RIGHT:
+        direction = "Right"
+    elif status & STATUS_DIR_LEFT:
+        direction = "Left"
+    else:
+        direction = "Stationary"
+    return {
+        "sensor": (status & STATUS_SENSOR_MASK) >> STATUS_SENSOR_SHIFT,
+        "seq": seq,
+        "t_us": t_us,
+        "distance": dist,
+        "yaw": yaw_cd / 100.0,
+        "direction": direction,
+        "object": "Detected" if status & STATUS_OBJECT else "None",
+        "gyro": "Moving" if status & STATUS_MOVING else "Still",
+        "strength": strength,
+        "temp": temp / 10.0,
+    }
+
+
+def decode_counters(payload, fields, record_type):
+    count = min(len(payload) // 4, len(fields))
+    values = struct.unpack_from("<%dI" % count, payload)
+    out = dict(zip(fields, values))
+    out["type"] = record_type
+    return out
+
+
+def decode_stats(payload):
+    return decode_counters(payload, STATS_FIELDS, "stats")
+
+
+def decode_loop_stats(payload):
+    return decode_counters(payload, LOOP_FIELDS, "loop")
+
+
+DECODERS = {
+    FRAME_SAMPLE: (SAMPLE_SIZE, decode_sample),
+    FRAME_STATS: (0, decode_stats),
+    FRAME_LOOP_STATS: (0, decode_loop_stats),
+}
+
+
+class StreamDecoder:
+    """Reassembles text lines and binary frames from arbitrary byte chunks.
+
+    Everything thrown away is counted rather than returned: frames failing
+    their CRC, frames of an unknown type or too short for theirs, text lines
+    without a single key=value, and resyncs (each run of bytes skipped to
+    find the next frame or line). A corrupted frame usually shows as a CRC
+    error followed by a resync over the rest of its bytes.
+    """
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.bytes_in = 0
+        self.text_records = 0
+        self.binary_records = 0
+        self.crc_errors = 0
+        self.bad_frames = 0
+        self.bad_lines = 0
+        self.resyncs = 0
+
+    @property
+    def errors(self):
+        """Every discard counted above, for a single error figure."""
+        return self.crc_errors + self.bad_frames + self.bad_lines + self.resyncs
+
+    def feed(self, data):
+        """Append received bytes and return every complete record as a dict.
+
+        Everything complete in the buffer is decoded in one pass: runs of
+        text are split into lines at once and binary frames are unpacked in
+        place, so a large read costs one call rather than one per record.
+        """
+        self.bytes_in += len(data)
+        buf = self.buf
+        buf += data
+        records = []
+        pos = 0
+        size = len(buf)
+        with memoryview(buf) as view:
+            while pos < size:
+                if buf[pos] == SYNC[0]:
+                    if size - pos < 4:
+                        break
+                    if buf[pos + 1] != SYNC[1]:
+                        self.resyncs += 1
+                        pos += 1
+                        continue
+                    end = pos + buf[pos + 3] + FRAME_OVERHEAD
+                    if end > size:
+                        break
+                    crc = buf[end - 2] | buf[end - 1] << 8
+                    if binascii.crc_hqx(view[pos + 2:end - 2], 0xFFFF) != crc:
+                        self.crc_errors += 1
+                        pos += 1
+                        continue
+                    decoder = DECODERS.get(buf[pos + 2])
+                    if decoder and buf[pos + 3] >= decoder[0]:
+                        records.append(decoder[1](view[pos + 4:end - 2]))
+                        self.binary_records += 1
+                    else:
+                        self.bad_frames += 1
+                    pos = end
+                    continue
+
+                # Text up to the next sync byte; one can never appear in
+                # (ASCII) text, so it also ends a garbled partial line.
+                sync = buf.find(SYNC[:1], pos)
+                stop = size if sync == -1 else sync
+                nl = buf.rfind(b"\n", pos, stop)
+                if nl == -1:
+                    if sync != -1:
+                        self.resyncs += 1
+                        pos = sync
+                        continue
+                    if size - pos > MAX_LINE:
+                        self.resyncs += 1
+                        pos = size
+                    break
+                for line in buf[pos:nl].split(b"\n"):
+                    line = line.strip()
+                    if line:
+                        record = decode_line(line)
+                        if not record:
+                            self.bad_lines += 1
+                            continue
+                        records.append(record)
+                        self.text_records += 1
+                if sync == -1 or nl + 1 == sync:
+                    pos = nl + 1
+                else:
+                    self.resyncs += 1
+                    pos = sync
+        del buf[:pos]
+        return records
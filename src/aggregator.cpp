@@ -0,0 +1,59 @@
+#include "aggregator.h"
+
+void aggregatorInit(Aggregator &agg, AggregateMode mode, uint16_t binCentideg, uint32_t periodUs) {
+  agg.mode = mode;
+  agg.binCentideg = binCentideg ? binCentideg : 1;
+  agg.periodUs = periodUs;
+  agg.count = 0;
+}
+
+static void insertSorted(Aggregator &agg, const TelemetrySample &in) {
+  uint8_t i = agg.count;
+  while (i > 0 && agg.distances[i - 1] > in.distance) {
+    agg.distances[i] = agg.distances[i - 1];
+    agg.objects[i] = agg.objects[i - 1];
+    i--;
+  }
+  agg.distances[i] = in.distance;
+  agg.objects[i] = in.status & STATUS_OBJECT;
+}
+
+static void closeWindow(Aggregator &agg, TelemetrySample &out) {
+  out = agg.pending;
+  if (agg.mode == AGG_BIN_MEDIAN) {
+    uint8_t mid = agg.count / 2;
+    out.distance = agg.distances[mid];
+    out.status = (out.status & ~STATUS_OBJECT) | agg.objects[mid];
+  }
+  agg.count = 0;
+}
+
+bool aggregatorAdd(Aggregator &agg, const TelemetrySample &in, TelemetrySample &out) {
+  if (agg.mode == AGG_NONE) {
+    out = in;
+    return true;
+  }
+
+  bool ready = false;
+  uint16_t bin = in.yawCentideg / agg.binCentideg;
+  if (agg.count) {
+    bool close = in.timestampUs - agg.windowStartUs >= agg.periodUs;
+    if (agg.mode != AGG_RATE && bin != agg.bin) close = true;
+    if (agg.mode == AGG_BIN_MEDIAN && agg.count == AGG_MEDIAN_MAX) close = true;
+    if (close) {
+      closeWindow(agg, out);
+      ready = true;
+    }
+  }
+
+  if (agg.count == 0) {
+    agg.bin = bin;
+    agg.windowStartUs = in.timestampUs;
+    agg.pending = in;
+  } else if (agg.mode == AGG_BIN_MEDIAN || in.distance < agg.pending.distance) {
+    agg.pending = in;
+  }
+  if (agg.mode == AGG_BIN_MEDIAN) insertSorted(agg, in);
+  agg.count++;
+  return ready;
+}
@@ -0,0 +1,28 @@
+#include "command_line.h"
+
+bool commandLineFeed(CommandLine &line, uint8_t data) {
+  if (data == '\n') {
+    bool complete = line.len > 0 && !line.overflow;
+    line.buf[line.len] = '\0';
+    line.len = 0;
+    line.overflow = false;
+    return complete;
+  }
+  if (data == '\r') return false;
+  if (line.len == COMMAND_LINE_MAX) {
+    line.overflow = true;
+    return false;
+  }
+  if (data >= 'a' && data <= 'z') data -= 'a' - 'A';
+  line.buf[line.len++] = data;
+  return false;
+}
+
+char *commandLineArgs(CommandLine &line) {
+  char *p = line.buf;
+  while (*p && *p != ' ') p++;
+  if (!*p) return p;
+  *p++ = '\0';
+  while (*p == ' ') p++;
+  return p;
+}
@@ -1,132 +1,1178 @@
 #include <Arduino.h>
-#include <SoftwareSerial.h>
 #include <Wire.h>
+#include "aggregator.h"
+#include "command_line.h"
+#include "scheduler.h"
+#include "stage_timer.h"
+#include "telemetry.h"
+#include "tfmini.h"
+#include "tilt.h"
+#include "tx_queue.h"
+#include "yaw.h"
+
+// 1 = compact binary frames (see telemetry.h), 0 = key=value text lines
+#ifndef TELEMETRY_BINARY
+#define TELEMETRY_BINARY 0
+#endif
+
+// LIDAR_HW_SERIAL names a hardware UART (e.g. Serial1) for the TFmini Plus;
+// otherwise it runs on SoftwareSerial, which can't keep up at 115200 on a
+// 16 MHz AVR and blocks interrupts for every byte it receives.
+//
+// LIDAR_RX_ISR (AVR USART1 only) bypasses the core's Serial1 driver: our own
+// RX interrupt pushes bytes into lidarRx, a LIDAR_RX_BUFFER-byte ring buffer
+// that counts overflows, and loop() drains it. Serial1 must not be used
+// anywhere else in that build or its ISR would be linked in as well.
+//
+// That is unit 0. LIDAR2_HW_SERIAL and LIDAR3_HW_SERIAL add units on further
+// hardware UARTs (Mega: Serial2, Serial3), and LIDAR_I2C_ADDRS lists TFmini
+// Plus units switched to I2C mode on the IMU bus (e.g. 0x10,0x11). Units are
+// numbered in that order and tag their samples with the number.
+// LIDAR_MOUNTS gives each unit's beam direction relative to the heading in
+// centidegrees (e.g. 0,9000,27000), LIDAR_IMUS the IMU it is mounted on.
+#ifndef LIDAR_RX_BUFFER
+#define LIDAR_RX_BUFFER 128
+#endif
+#ifndef LIDAR_MOUNTS
+#define LIDAR_MOUNTS 0
+#endif
+#ifndef LIDAR_IMUS
+#define LIDAR_IMUS 0
+#endif
 
+#if defined(LIDAR_RX_ISR)
+#if !defined(USART1_RX_vect)
+#error "LIDAR_RX_ISR needs an AVR with USART1 (Leonardo, Mega)"
+#endif
+#include <util/atomic.h>
+#include "ring_buffer.h"
+RingBuffer<LIDAR_RX_BUFFER> lidarRx;
+volatile uint16_t lidarUartOverruns = 0; // bytes lost in the UART itself
+#elif defined(LIDAR_HW_SERIAL)
+decltype(LIDAR_HW_SERIAL) &lidarSerial = LIDAR_HW_SERIAL;
+#else
+#include <SoftwareSerial.h>
 SoftwareSerial lidarSerial(2, 3); // LiDAR TX -> D2, RX -> D3
+uint32_t lidarSoftOverflows = 0;  // polls that found the RX buffer overflowed
+#endif
+
+const uint8_t LIDAR_UART_COUNT = 1
+#ifdef LIDAR2_HW_SERIAL
+                                 + 1
+#endif
+#ifdef LIDAR3_HW_SERIAL
+                                 + 1
+#endif
+    ;
+#ifdef LIDAR_I2C_ADDRS
+const uint8_t lidarI2cAddresses[] = {LIDAR_I2C_ADDRS};
+const uint8_t LIDAR_I2C_COUNT = sizeof(lidarI2cAddresses);
+#else
+const uint8_t LIDAR_I2C_COUNT = 0;
+#endif
+const uint8_t LIDAR_COUNT = LIDAR_UART_COUNT + LIDAR_I2C_COUNT;
+static_assert(LIDAR_COUNT <= TELEMETRY_MAX_SENSORS, "too many LiDARs for the sample sensor ID");
+const int16_t lidarMounts[] = {LIDAR_MOUNTS};
+const uint8_t lidarImus[] = {LIDAR_IMUS};
+
+enum LidarLink : uint8_t {
+  LINK_STREAM, // HardwareSerial or SoftwareSerial
+  LINK_RX_ISR, // lidarRx
+  LINK_I2C,    // polled over Wire
+};
+
+struct LidarUnit {
+  uint8_t id;
+  LidarLink link;
+  Stream *stream;          // LINK_STREAM
+  uint8_t i2cAddress;      // LINK_I2C
+  bool i2cRequested;       // LINK_I2C: a frame was asked for and not read yet
+  unsigned long i2cPollUs; // LINK_I2C: when it was asked for
+  unsigned long pollPeriodUs;
+  int16_t mountCentideg;
+  uint8_t imu;             // index into imus[]
+  TFminiParser parser;
+  Aggregator aggregator;
+  uint32_t framesLastInterval;
+  uint32_t weakFrames;
+  unsigned long frameStartUs;
+};
+LidarUnit lidars[LIDAR_COUNT];
+
+// Every loop serves the units in turn, at most LIDAR_BYTES_PER_TURN bytes
+// each (several frames, far more than arrive between two loops), starting one
+// unit further on each time so none gets the first pick.
+const uint8_t LIDAR_BYTES_PER_TURN = 32;
+uint8_t lidarTurn = 0;
+
+// In I2C mode the TFmini Plus measures on request; the frame is read back
+// this long after asking, on a later loop, instead of holding the bus.
+const unsigned long LIDAR_I2C_READ_US = 1000;
+
+// Output rate requested from the TFmini Plus at startup (it defaults to
+// 100 Hz). Match it to what the link can carry after decimation rather than
+// decoding frames only to drop them. LIDAR_SAVE_SETTINGS also stores it in
+// the sensor's flash. I2C units are polled at this rate.
+#ifndef LIDAR_FRAME_RATE
+#define LIDAR_FRAME_RATE 100
+#endif
+
+// Frames weaker than this (or saturated) are dropped before anything else
+// is done with them.
+#ifndef LIDAR_MIN_STRENGTH
+#define LIDAR_MIN_STRENGTH 100
+#endif
+uint16_t lidarMinStrength = LIDAR_MIN_STRENGTH;
+
+// Frames are stamped with the estimated arrival time of their first header
+// byte: the time it is read, minus one byte time (10 bits at 115200 baud)
+// for every byte still queued behind it.
+const unsigned long LIDAR_BYTE_US = 87;
 
-// LiDAR variables
-int dist;
-int uart[9];
-const int HEADER = 0x59;
+// IMU configuration. The gyro output rate is 8 kHz with the DLPF off
+// (IMU_DLPF 0) and 1 kHz with it on (1..6 = 188, 98, 42, 20, 10, 5 Hz); the
+// sample rate is that divided by 1 + IMU_SAMPLE_DIV.
+#ifndef IMU_I2C_CLOCK
+#define IMU_I2C_CLOCK 400000 // fast mode; 100000 for long or weakly pulled-up wiring
+#endif
+#ifndef IMU_DLPF
+#define IMU_DLPF 1
+#endif
+#ifndef IMU_SAMPLE_DIV
+#define IMU_SAMPLE_DIV 4 // 200 Hz
+#endif
 
-// MPU6050 variables
-const int MPU = 0x68;
-float GyroZ;
-float yaw = 0;
-float GyroErrorZ;
-float elapsedTime, currentTime, previousTime;
-int c = 0;
+struct ImuConfig {
+  uint32_t i2cClock;  // Hz
+  uint8_t dlpf;       // CONFIG (0x1A) DLPF_CFG
+  uint8_t sampleDiv;  // SMPLRT_DIV (0x19)
+};
+const ImuConfig imuConfig = {IMU_I2C_CLOCK, IMU_DLPF, IMU_SAMPLE_DIV};
+
+// IMU_FIFO buffers GyroZ in the MPU6050 FIFO at the configured sample rate;
+// readMPU6050() then fetches every buffered sample in one burst and
+// integrates each over the exact sample period.
+//
+// IMU_FUSION reads the accelerometer and all three gyro axes in one 14-byte
+// burst (ACCEL_XOUT_H 0x3B .. GYRO_ZOUT_L 0x48) instead of GyroZ alone, and
+// integrates the tilt-compensated turn rate about the vertical (see tilt.h).
+#if defined(IMU_FIFO) && defined(IMU_INT_PIN)
+#error "IMU_FIFO and IMU_INT_PIN are alternatives, pick one"
+#endif
+#if defined(IMU_FUSION) && defined(IMU_FIFO)
+#error "IMU_FUSION needs the accelerometer, the FIFO only holds GyroZ"
+#endif
+#if defined(IMU_INT_PIN) && !defined(LIDAR_HW_SERIAL) && !defined(LIDAR_RX_ISR) && (IMU_INT_PIN == 2 || IMU_INT_PIN == 3)
+#error "D2/D3 are taken by the SoftwareSerial LiDAR link"
+#endif
+#ifdef IMU_FIFO
+unsigned long imuSamplePeriod; // us, from imuConfig
+const uint8_t IMU_FIFO_BURST = 16; // samples per read, bounded by the 32-byte Wire buffer
+const uint8_t IMU_FIFO_BATCH = 4;  // samples expected per scheduled read
+#endif
+#ifdef IMU_INT_PIN
+volatile bool imuDataReady = false;
+volatile unsigned long imuReadyMicros = 0;
+#endif
+
+// MPU6050s. IMU_COUNT 2 adds a second one at 0x69 (AD0 pulled high) on the
+// same bus, for LiDARs on a second turret (see LIDAR_IMUS). Each integrates
+// and tracks its own bias; the read mode above applies to both.
+#ifndef IMU_COUNT
+#define IMU_COUNT 1
+#endif
+#if IMU_COUNT < 1 || IMU_COUNT > 2
+#error "IMU_COUNT must be 1 or 2, the MPU6050 has two addresses"
+#endif
+#if defined(IMU_INT_PIN) && IMU_COUNT > 1
+#error "IMU_INT_PIN serves a single IMU"
+#endif
+const uint8_t MPU_ADDRESSES[] = {0x68, 0x69};
+
+struct Imu {
+  uint8_t address;
+  YawIntegrator yaw;
+  BiasTracker biasTracker;
+  unsigned long lastMicros;
+  uint8_t calibRemaining;
+  int32_t calibSum;
+  uint32_t fifoOverflows; // IMU_FIFO
+#ifdef IMU_FUSION
+  TiltFilter tilt;
+  int32_t calibSumXY[2];
+#endif
+};
+Imu imus[IMU_COUNT];
+
+// I2C transaction time of each gyro read, per stats interval
+unsigned long i2cReadUsTotal = 0;
+uint16_t i2cReadCount = 0;
+uint16_t i2cReadUsMax = 0;
 
 // Gyro movement detection
-bool gyroMoving = false;
-float gyroThreshold = 1.5; // deg/s
+const int32_t gyroThreshold = 1.5 * GYRO_Q4_PER_DPS; // 1.5 °/s, same units as yaw.rateQ4
+
+// Decimation before the host link (see aggregator.h). AGG_PERIOD_MS is the
+// output period in AGG_RATE mode and the longest a bin stays open otherwise.
+// Every LiDAR unit has its own aggregator.
+#ifndef AGG_MODE
+#define AGG_MODE AGG_NONE
+#endif
+#ifndef AGG_BIN_CENTIDEG
+#define AGG_BIN_CENTIDEG 100 // 1°, the host map's resolution
+#endif
+#ifndef AGG_PERIOD_MS
+#define AGG_PERIOD_MS 100
+#endif
+
+// Telemetry
+bool binaryTelemetry = TELEMETRY_BINARY;
+uint16_t sampleSeq = 0;
+uint32_t samplesSent = 0;
+const unsigned long STATS_INTERVAL_MS = 1000;
+unsigned long lastStatsTime = 0;
+
+// In text mode the stats and loop records go out a line at a time (see
+// telemetryFormatStats()): each line once the TX queue has room for it next
+// to the samples, or TEXT_LINE_MAX_WAIT_MS after the previous one at the
+// latest, when the drop policy has to make room.
+const unsigned long TEXT_LINE_MAX_WAIT_MS = STATS_INTERVAL_MS / 8;
+TelemetryStats textStats;
+TelemetryLoopStats textLoopStats;
+uint8_t textStatsField = STATS_FIELD_COUNT;
+uint8_t textLoopField = LOOP_STATS_FIELD_COUNT;
+unsigned long textLineTime = 0;
+
+// Everything for the host goes through txQueue (see tx_queue.h) and out as
+// fast as the Serial TX buffer drains, so loop() never blocks on the host.
+// TX_DROP_POLICY picks what is dropped when it's full; TXDROP changes it.
+#ifndef TX_DROP_POLICY
+#define TX_DROP_POLICY TX_DROP_OLDEST
+#endif
+TxQueue txQueue;
+
+// Host link. The firmware boots at HOST_BAUD. BAUD <rate> switches to a
+// faster rate once its ack is out; the host then has BAUD_CONFIRM_MS to
+// answer with PING at the new rate, or the firmware goes back to the old one.
+#ifndef HOST_BAUD
+#define HOST_BAUD 115200
+#endif
+const unsigned long BAUD_CONFIRM_MS = 1000;
+uint32_t hostBaud = HOST_BAUD;
+uint32_t baudFallback = 0; // rate to go back to while a switch is unconfirmed
+unsigned long baudSwitchTime = 0;
+
+// A switch waits in flushTx() for the bytes queued before it (the ack
+// included) to leave at the old rate. Later records stay queued for the
+// new rate. Serial's TX buffer must be empty too, and the last two bytes
+// (UDR and the shift register) must have had time to go out, so loop()
+// never blocks on it.
+uint32_t pendingBaud = 0;
+uint16_t pendingBaudBytes = 0;  // still to send at the old rate
+int serialTxRoom = 0;           // availableForWrite() with nothing buffered
+unsigned long serialIdleUs = 0; // when Serial was last seen busy
+static_assert(TX_QUEUE_SIZE >= int(TELEMETRY_TEXT_MAX), "TX queue must hold the longest text line");
+
+// loop() is a cooperative scheduler (see scheduler.h) with three tasks:
+//   imu    every imuTaskPeriodUs(), so the gyro is read when it has a new
+//          sample rather than whenever loop() comes round; late by more than
+//          a quarter period is a miss. IMU_INT_PIN builds instead run it on
+//          every pass and it reads only after a data-ready interrupt.
+//   lidar  every pass, parsing whatever bytes are pending; a miss is a gap
+//          long enough for LIDAR_BYTES_PER_TURN bytes to pile up.
+//   host   commands, TX and stats, in the time left over: only while the
+//          next IMU release is at least hostSliceUs away, unless it has
+//          already waited HOST_DEADLINE_US (a miss).
+// Each stats interval a type=loop record (frame 0x03) reports the loop rate
+// and the misses per task.
+const unsigned long HOST_SLICE_US = 1000;
+const unsigned long HOST_DEADLINE_US = 10000;
+Task imuTask, lidarTask, hostTask;
+unsigned long hostSliceUs;
+uint32_t loopCount = 0;
+
+// LOOP_STATS also times each loop() stage and adds min/avg/max microseconds
+// per stage over the interval to the type=loop record. Off by default,
+// micros() around every stage isn't free.
+#ifdef LOOP_STATS
+StageTimer imuStage, lidarStage, txStage, cmdStage;
+#define TIME_STAGE(timer, code) \
+  do { \
+    unsigned long stageStart = micros(); \
+    code; \
+    stageTimerAdd(timer, micros() - stageStart); \
+  } while (0)
+#else
+#define TIME_STAGE(timer, code) \
+  do { \
+    code; \
+  } while (0)
+#endif
 
-void calculate_IMU_error();
-void readMPU6050();
+// Host commands, one per line (see runCommand()). Only a few bytes are taken
+// per loop so a chatty host can't hold up the sensors.
+CommandLine commandLine;
+const uint8_t COMMAND_BYTES_PER_LOOP = 16;
+
+// The bias is tracked in the background whenever the sensor is still (see
+// BiasTracker), so startup only averages BIAS_STARTUP_SAMPLES readings for a
+// first estimate. CALIB re-estimates it from the next CALIB_SAMPLES readings
+// while everything else keeps running.
+#ifndef BIAS_STARTUP_SAMPLES
+#define BIAS_STARTUP_SAMPLES 32
+#endif
+const int32_t biasStillThreshold = 0.3 * GYRO_Q4_PER_DPS; // °/s
+const uint8_t CALIB_SAMPLES = 200;
+
+void calculate_IMU_error(Imu &imu);
+void initImu(Imu &imu, uint8_t address);
+void integrateGyro(Imu &imu, int16_t raw, unsigned long dtUs);
+void writeMPU(const Imu &imu, uint8_t reg, uint8_t value);
+int16_t readGyroZ(const Imu &imu);
+void readMotion(const Imu &imu, int16_t accel[3], int16_t gyro[3]);
+int16_t readYawRate(Imu &imu, unsigned long dtUs);
+unsigned long imuSamplePeriodUs();
+unsigned long imuTaskPeriodUs();
+bool hostTimeLeft(unsigned long now);
+void runHost();
+void noteI2cRead(unsigned long start);
+void readImus();
+void readMPU6050(Imu &imu);
+void onImuDataReady();
+void lidarBegin(uint32_t baud);
+void initLidar(LidarUnit &unit, uint8_t id, LidarLink link);
+bool lidarReadByte(LidarUnit &unit, uint8_t &data);
+uint32_t lidarRxOverflows();
+uint8_t lidarRxHighWater();
+uint16_t lidarPending(LidarUnit &unit);
+void lidarWrite(LidarUnit &unit, const uint8_t *data, uint8_t len);
+void lidarConfigure(LidarUnit &unit, uint16_t frameRate);
+void readLidars();
+void readLidar(LidarUnit &unit);
+void pollI2cLidar(LidarUnit &unit);
+void handleLidarFrame(LidarUnit &unit);
+void sendRecord(const uint8_t *data, size_t len, bool sample);
+void flushTx();
+void setHostBaud(uint32_t baud);
+void switchBaudWhenDrained();
+bool validHostBaud(long baud);
+void sendSample(TelemetrySample &sample);
+void sendStats();
+void sendLoopStats();
+void sendTextStatsLine();
+void pollCommands();
+void runCommand();
+bool setAggregateMode(const char *name);
+bool setDropPolicy(const char *name);
+void resetCounters();
+void lidarResetRxCounters();
 
 void setup() {
-  Serial.begin(9600);
-  lidarSerial.begin(115200);
+  Serial.begin(hostBaud);
+  serialTxRoom = Serial.availableForWrite();
+  txQueueInit(txQueue, TX_DROP_POLICY);
+  lidarBegin(115200);
+#ifdef LIDAR_RX_ISR
+  initLidar(lidars[0], 0, LINK_RX_ISR);
+#else
+  initLidar(lidars[0], 0, LINK_STREAM);
+  lidars[0].stream = &lidarSerial;
+#endif
+#ifdef LIDAR2_HW_SERIAL
+  LIDAR2_HW_SERIAL.begin(115200);
+  initLidar(lidars[1], 1, LINK_STREAM);
+  lidars[1].stream = &LIDAR2_HW_SERIAL;
+#endif
+#ifdef LIDAR3_HW_SERIAL
+  LIDAR3_HW_SERIAL.begin(115200);
+  initLidar(lidars[LIDAR_UART_COUNT - 1], LIDAR_UART_COUNT - 1, LINK_STREAM);
+  lidars[LIDAR_UART_COUNT - 1].stream = &LIDAR3_HW_SERIAL;
+#endif
+#ifdef LIDAR_I2C_ADDRS
+  for (uint8_t i = 0; i < LIDAR_I2C_COUNT; i++) {
+    LidarUnit &unit = lidars[LIDAR_UART_COUNT + i];
+    initLidar(unit, LIDAR_UART_COUNT + i, LINK_I2C);
+    unit.i2cAddress = lidarI2cAddresses[i];
+  }
+#endif
+  for (uint8_t i = 0; i < LIDAR_COUNT; i++) lidarConfigure(lidars[i], LIDAR_FRAME_RATE);
   Wire.begin();
+  Wire.setClock(imuConfig.i2cClock);
+
+  for (uint8_t i = 0; i < IMU_COUNT; i++) initImu(imus[i], MPU_ADDRESSES[i]);
+#ifdef IMU_FIFO
+  imuSamplePeriod = imuSamplePeriodUs();
+#endif
+  unsigned long now = micros();
+  // A quarter of the task period; IMU_INT_PIN builds have none and take a
+  // quarter sample period instead
+  unsigned long imuPeriod = imuTaskPeriodUs();
+  taskInit(imuTask, imuPeriod, (imuPeriod ? imuPeriod : imuSamplePeriodUs()) / 4, now);
+  taskInit(lidarTask, 0, LIDAR_BYTES_PER_TURN * LIDAR_BYTE_US, now);
+  taskInit(hostTask, 0, HOST_DEADLINE_US, now);
+  hostSliceUs = imuSamplePeriodUs() / 2;
+  if (hostSliceUs > HOST_SLICE_US) hostSliceUs = HOST_SLICE_US;
+#ifdef LOOP_STATS
+  stageTimerReset(imuStage);
+  stageTimerReset(lidarStage);
+  stageTimerReset(txStage);
+  stageTimerReset(cmdStage);
+#endif
+
+#ifdef IMU_INT_PIN
+  writeMPU(imus[0], 0x37, 0x00); // INT active high, push-pull, 50 us pulse
+  writeMPU(imus[0], 0x38, 0x01); // DATA_RDY_EN
+  pinMode(IMU_INT_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(IMU_INT_PIN), onImuDataReady, RISING);
+#endif
+}
+
+void initLidar(LidarUnit &unit, uint8_t id, LidarLink link) {
+  memset(&unit, 0, sizeof(unit));
+  unit.id = id;
+  unit.link = link;
+  unit.mountCentideg = id < sizeof(lidarMounts) / sizeof(lidarMounts[0]) ? lidarMounts[id] : 0;
+  unit.imu = id < sizeof(lidarImus) && lidarImus[id] < IMU_COUNT ? lidarImus[id] : 0;
+  tfminiReset(unit.parser);
+  aggregatorInit(unit.aggregator, AGG_MODE, AGG_BIN_CENTIDEG, AGG_PERIOD_MS * 1000UL);
+}
+
+void initImu(Imu &imu, uint8_t address) {
+  memset(&imu, 0, sizeof(imu));
+  imu.address = address;
 
   // Wake MPU6050
-  Wire.beginTransmission(MPU);
-  Wire.write(0x6B);
-  Wire.write(0x00);
-  Wire.endTransmission(true);
+  writeMPU(imu, 0x6B, 0x00);
 
   // Accel ±8g
-  Wire.beginTransmission(MPU);
-  Wire.write(0x1C);
-  Wire.write(0x10);
-  Wire.endTransmission(true);
+  writeMPU(imu, 0x1C, 0x10);
 
   // Gyro ±1000°/s
-  Wire.beginTransmission(MPU);
-  Wire.write(0x1B);
-  Wire.write(0x10);
-  Wire.endTransmission(true);
+  writeMPU(imu, 0x1B, 0x10);
+
+  // Low pass filter and sample rate
+  writeMPU(imu, 0x1A, imuConfig.dlpf);
+  writeMPU(imu, 0x19, imuConfig.sampleDiv);
 
   delay(20);
-  calculate_IMU_error();
+  yawReset(imu.yaw);
+  calculate_IMU_error(imu);
   delay(20);
+  imu.lastMicros = micros();
+
+#ifdef IMU_FIFO
+  writeMPU(imu, 0x23, 0x10);           // FIFO gets GyroZ only
+  writeMPU(imu, 0x6A, 0x04);           // FIFO reset
+  writeMPU(imu, 0x6A, 0x40);           // FIFO enable
+#endif
 }
 
 void loop() {
-  readMPU6050();
-
-  // Read LiDAR
-  if (lidarSerial.available()) {
-    if (lidarSerial.read() == HEADER) {
-      uart[0] = HEADER;
-      if (lidarSerial.read() == HEADER) {
-        uart[1] = HEADER;
-        for (int i = 2; i < 9; i++) {
-          uart[i] = lidarSerial.read();
-        }
-        int check = 0;
-        for (int i = 0; i < 8; i++) check += uart[i];
-        if (uart[8] == (check & 0xff)) {
-          dist = uart[2] + uart[3] * 256;
-
-          if (dist > 70) dist = 70; // Limit
-
-          // Direction
-          String direction = "Stationary";
-          if (GyroZ > gyroThreshold) direction = "Right";
-          else if (GyroZ < -gyroThreshold) direction = "Left";
-
-          // Object detection
-          String objStatus = (dist < 70) ? "Detected" : "None";
-
-          // Gyro status
-          gyroMoving = abs(GyroZ) > gyroThreshold;
-          String gyroStatus = gyroMoving ? "Moving" : "Still";
-
-          // Send to Python
-          Serial.print("distance=");
-          Serial.print(dist);
-          Serial.print(",yaw=");
-          Serial.print(yaw);
-          Serial.print(",direction=");
-          Serial.print(direction);
-          Serial.print(",object=");
-          Serial.print(objStatus);
-          Serial.print(",gyro=");
-          Serial.println(gyroStatus);
-        }
+  unsigned long now = micros();
+#ifdef IMU_INT_PIN
+  taskRan(imuTask, now);
+  TIME_STAGE(imuStage, readImus());
+#else
+  if (taskDue(imuTask, now)) TIME_STAGE(imuStage, readImus());
+#endif
+
+  now = micros();
+  taskRan(lidarTask, now);
+  TIME_STAGE(lidarStage, readLidars());
+
+  now = micros();
+  if (hostTimeLeft(now) || now - hostTask.releaseUs > hostTask.deadlineUs) {
+    taskRan(hostTask, now);
+    runHost();
+  }
+  loopCount++;
+}
+
+void runHost() {
+  TIME_STAGE(cmdStage, pollCommands());
+  TIME_STAGE(txStage, flushTx());
+
+  if (millis() - lastStatsTime >= STATS_INTERVAL_MS) {
+    lastStatsTime += STATS_INTERVAL_MS;
+    sendStats();
+    sendLoopStats();
+  }
+  sendTextStatsLine();
+}
+
+// With the data-ready interrupt the next IMU read isn't scheduled, so
+// nothing is held back for it.
+bool hostTimeLeft(unsigned long now) {
+#ifdef IMU_INT_PIN
+  return true;
+#else
+  return taskSlackUs(imuTask, now) >= hostSliceUs;
+#endif
+}
+
+void readLidars() {
+  for (uint8_t n = 0; n < LIDAR_COUNT; n++) {
+    readLidar(lidars[(lidarTurn + n) % LIDAR_COUNT]);
+  }
+  if (++lidarTurn >= LIDAR_COUNT) lidarTurn = 0;
+}
+
+// Read LiDAR: consume the bytes already buffered, one at a time
+void readLidar(LidarUnit &unit) {
+  if (unit.link == LINK_I2C) {
+    pollI2cLidar(unit);
+    return;
+  }
+  uint8_t data;
+  for (uint8_t n = 0; n < LIDAR_BYTES_PER_TURN && lidarReadByte(unit, data); n++) {
+    if (unit.parser.pos == 0) unit.frameStartUs = micros() - lidarPending(unit) * LIDAR_BYTE_US;
+    uint32_t checksumErrors = unit.parser.checksumErrors;
+    if (tfminiFeed(unit.parser, data)) {
+      handleLidarFrame(unit);
+    } else if (unit.parser.checksumErrors != checksumErrors && unit.parser.pos) {
+      // The parser kept the failed frame's tail as the start of the next
+      // one; its first byte came pos - 1 bytes before this one
+      unit.frameStartUs = micros() - (lidarPending(unit) + unit.parser.pos - 1) * LIDAR_BYTE_US;
+    }
+  }
+}
+
+// The sensor measures when asked, so the request time is the frame's time
+void pollI2cLidar(LidarUnit &unit) {
+  unsigned long now = micros();
+  if (!unit.i2cRequested) {
+    if (now - unit.i2cPollUs < unit.pollPeriodUs) return;
+    uint8_t cmd[TFMINI_CMD_MAX];
+    uint8_t format = TFMINI_FORMAT_CM;
+    lidarWrite(unit, cmd, tfminiCommand(cmd, TFMINI_ID_GET_FRAME, &format, 1));
+    unit.i2cRequested = true;
+    unit.i2cPollUs = now;
+    return;
+  }
+  if (now - unit.i2cPollUs < LIDAR_I2C_READ_US) return;
+  unit.i2cRequested = false;
+  unit.frameStartUs = unit.i2cPollUs;
+  Wire.requestFrom(unit.i2cAddress, TFMINI_FRAME_LEN, (uint8_t)true);
+  while (Wire.available()) {
+    if (tfminiFeed(unit.parser, Wire.read())) handleLidarFrame(unit);
+  }
+}
+
+#if defined(LIDAR_RX_ISR)
+ISR(USART1_RX_vect) {
+  uint8_t status = UCSR1A;
+  uint8_t data = UDR1;
+  if (status & _BV(DOR1)) lidarUartOverruns++;
+  lidarRx.push(data);
+}
+
+void lidarBegin(uint32_t baud) {
+  // 8N1, double speed, same divisor rounding as the Arduino core
+  uint16_t setting = (F_CPU / 4 / baud - 1) / 2;
+  UBRR1H = setting >> 8;
+  UBRR1L = setting & 0xff;
+  UCSR1A = _BV(U2X1);
+  UCSR1C = _BV(UCSZ11) | _BV(UCSZ10);
+  UCSR1B = _BV(RXEN1) | _BV(TXEN1) | _BV(RXCIE1);
+}
+
+uint32_t lidarRxOverflows() {
+  uint32_t total;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    total = (uint32_t)lidarRx.overflows + lidarUartOverruns;
+  }
+  return total;
+}
+
+uint8_t lidarRxHighWater() {
+  return lidarRx.highWater;
+}
+
+void lidarResetRxCounters() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    lidarRx.overflows = 0;
+    lidarRx.highWater = 0;
+    lidarUartOverruns = 0;
+  }
+}
+#else
+void lidarBegin(uint32_t baud) {
+  lidarSerial.begin(baud);
+}
+
+// The core's HardwareSerial drops bytes without telling anyone, so only the
+// SoftwareSerial and LIDAR_RX_ISR builds can report overflows, for unit 0.
+uint32_t lidarRxOverflows() {
+#ifndef LIDAR_HW_SERIAL
+  if (lidarSerial.overflow()) lidarSoftOverflows++;
+  return lidarSoftOverflows;
+#else
+  return 0;
+#endif
+}
+
+uint8_t lidarRxHighWater() {
+  return 0;
+}
+
+void lidarResetRxCounters() {
+#ifndef LIDAR_HW_SERIAL
+  lidarSerial.overflow();
+  lidarSoftOverflows = 0;
+#endif
+}
+#endif
+
+bool lidarReadByte(LidarUnit &unit, uint8_t &data) {
+#ifdef LIDAR_RX_ISR
+  if (unit.link == LINK_RX_ISR) return lidarRx.pop(data);
+#endif
+  if (!unit.stream->available()) return false;
+  data = unit.stream->read();
+  return true;
+}
+
+uint16_t lidarPending(LidarUnit &unit) {
+#ifdef LIDAR_RX_ISR
+  if (unit.link == LINK_RX_ISR) return lidarRx.size();
+#endif
+  return unit.stream->available();
+}
+
+void lidarWrite(LidarUnit &unit, const uint8_t *data, uint8_t len) {
+  if (unit.link == LINK_I2C) {
+    Wire.beginTransmission(unit.i2cAddress);
+    Wire.write(data, len);
+    Wire.endTransmission(true);
+    return;
+  }
+#ifdef LIDAR_RX_ISR
+  if (unit.link == LINK_RX_ISR) {
+    for (uint8_t i = 0; i < len; i++) {
+      while (!(UCSR1A & _BV(UDRE1))) {
       }
+      UDR1 = data[i];
+    }
+    return;
+  }
+#endif
+  unit.stream->write(data, len);
+}
+
+// I2C units have no frame rate of their own; they are polled at it instead.
+void lidarConfigure(LidarUnit &unit, uint16_t frameRate) {
+  unit.pollPeriodUs = 1000000UL / frameRate;
+  if (unit.link == LINK_I2C) return;
+  uint8_t cmd[TFMINI_CMD_MAX];
+  uint8_t format = TFMINI_FORMAT_CM;
+  lidarWrite(unit, cmd, tfminiCommand(cmd, TFMINI_ID_OUTPUT_FORMAT, &format, 1));
+  lidarWrite(unit, cmd, tfminiFrameRateCommand(cmd, frameRate));
+#ifdef LIDAR_SAVE_SETTINGS
+  lidarWrite(unit, cmd, tfminiCommand(cmd, TFMINI_ID_SAVE_SETTINGS, NULL, 0));
+#endif
+}
+
+void handleLidarFrame(LidarUnit &unit) {
+  uint16_t strength = tfminiStrength(unit.parser);
+  if (strength < lidarMinStrength || strength == TFMINI_STRENGTH_SATURATED) {
+    unit.weakFrames++;
+    return;
+  }
+
+  uint16_t dist = tfminiDistance(unit.parser);
+
+  if (dist > 70) dist = 70; // Limit
+
+  const Imu &imu = imus[unit.imu];
+  bool gyroMoving = abs(imu.yaw.rateQ4) > gyroThreshold;
+
+  // Heading at the frame's own timestamp rather than whenever the gyro was
+  // last read, which may be a whole loop iteration away, turned by the
+  // unit's mounting angle
+  int32_t heading = yawCentidegAt(imu.yaw, (int32_t)(unit.frameStartUs - imu.lastMicros));
+  heading = (heading + unit.mountCentideg) % 36000;
+  if (heading < 0) heading += 36000;
+
+  TelemetrySample sample;
+  sample.timestampUs = unit.frameStartUs;
+  sample.distance = dist;
+  sample.yawCentideg = heading;
+  sample.status = 0;
+  if (dist < 70) sample.status |= STATUS_OBJECT;
+  if (gyroMoving) sample.status |= STATUS_MOVING;
+  if (imu.yaw.rateQ4 > gyroThreshold) sample.status |= STATUS_DIR_RIGHT;
+  else if (imu.yaw.rateQ4 < -gyroThreshold) sample.status |= STATUS_DIR_LEFT;
+  sample.strength = strength;
+  sample.temperatureDeci = tfminiTemperatureDeci(unit.parser);
+  sample.sensor = unit.id;
+
+  TelemetrySample out;
+  if (aggregatorAdd(unit.aggregator, sample, out)) sendSample(out);
+}
+
+unsigned long imuSamplePeriodUs() {
+  unsigned long gyroRatePeriod = (imuConfig.dlpf == 0 || imuConfig.dlpf == 7) ? 125 : 1000;
+  return gyroRatePeriod * (1 + imuConfig.sampleDiv);
+}
+
+// IMU_FIFO reads IMU_FIFO_BATCH samples per burst; otherwise every sample is
+// read as it comes.
+unsigned long imuTaskPeriodUs() {
+#if defined(IMU_INT_PIN)
+  return 0;
+#elif defined(IMU_FIFO)
+  return imuSamplePeriodUs() * IMU_FIFO_BATCH;
+#else
+  return imuSamplePeriodUs();
+#endif
+}
+
+void noteI2cRead(unsigned long start) {
+  unsigned long took = micros() - start;
+  i2cReadUsTotal += took;
+  i2cReadCount++;
+  if (took > i2cReadUsMax) i2cReadUsMax = took;
+}
+
+int16_t readGyroZ(const Imu &imu) {
+  unsigned long start = micros();
+  Wire.beginTransmission(imu.address);
+  Wire.write(0x47); // GYRO_ZOUT_H
+  Wire.endTransmission(false);
+  Wire.requestFrom(imu.address, (uint8_t)2, (uint8_t)true);
+  int16_t raw = Wire.read() << 8 | Wire.read();
+  noteI2cRead(start);
+  return raw;
+}
+
+#ifdef IMU_FUSION
+// ACCEL_XOUT_H .. GYRO_ZOUT_L in one transaction; TEMP_OUT is in between
+void readMotion(const Imu &imu, int16_t accel[3], int16_t gyro[3]) {
+  unsigned long start = micros();
+  Wire.beginTransmission(imu.address);
+  Wire.write(0x3B); // ACCEL_XOUT_H
+  Wire.endTransmission(false);
+  Wire.requestFrom(imu.address, (uint8_t)14, (uint8_t)true);
+  for (uint8_t i = 0; i < 3; i++) accel[i] = Wire.read() << 8 | Wire.read();
+  Wire.read();
+  Wire.read();
+  for (uint8_t i = 0; i < 3; i++) gyro[i] = Wire.read() << 8 | Wire.read();
+  noteI2cRead(start);
+}
+
+// A running CALIB re-estimates the X and Y offsets alongside GyroZ;
+// integrateGyro() finishes it on the same reading.
+int16_t readYawRate(Imu &imu, unsigned long dtUs) {
+  int16_t accel[3], gyro[3];
+  readMotion(imu, accel, gyro);
+  if (imu.calibRemaining) {
+    imu.calibSumXY[0] += gyro[0];
+    imu.calibSumXY[1] += gyro[1];
+    if (imu.calibRemaining == 1) {
+      imu.tilt.gyroBias[0] = imu.calibSumXY[0] / CALIB_SAMPLES;
+      imu.tilt.gyroBias[1] = imu.calibSumXY[1] / CALIB_SAMPLES;
     }
   }
+  return tiltFilterUpdate(imu.tilt, accel, gyro, imu.yaw.biasQ4 >> 4, dtUs);
+}
+#else
+int16_t readYawRate(Imu &imu, unsigned long) {
+  return readGyroZ(imu);
+}
+#endif
+
+void writeMPU(const Imu &imu, uint8_t reg, uint8_t value) {
+  Wire.beginTransmission(imu.address);
+  Wire.write(reg);
+  Wire.write(value);
+  Wire.endTransmission(true);
+}
+
+void readImus() {
+  for (uint8_t i = 0; i < IMU_COUNT; i++) readMPU6050(imus[i]);
 }
 
-void readMPU6050() {
-  previousTime = currentTime;
-  currentTime = millis();
-  elapsedTime = (currentTime - previousTime) / 1000.0;
+#ifdef IMU_FIFO
+void readMPU6050(Imu &imu) {
+  unsigned long start = micros();
+  Wire.beginTransmission(imu.address);
+  Wire.write(0x72); // FIFO_COUNT_H
+  Wire.endTransmission(false);
+  Wire.requestFrom(imu.address, (uint8_t)2, (uint8_t)true);
+  uint16_t count = Wire.read() << 8 | Wire.read();
+
+  // A full FIFO means samples were lost and the byte order can no longer be
+  // trusted; start over rather than integrate garbage.
+  if (count >= 1024 || (count & 1)) {
+    imu.fifoOverflows++;
+    writeMPU(imu, 0x6A, 0x44);
+    noteI2cRead(start);
+    return;
+  }
+
+  uint8_t samples = count / 2;
+  if (samples == 0) {
+    noteI2cRead(start);
+    return;
+  }
+  if (samples > IMU_FIFO_BURST) samples = IMU_FIFO_BURST;
 
-  Wire.beginTransmission(MPU);
-  Wire.write(0x47);
+  Wire.beginTransmission(imu.address);
+  Wire.write(0x74); // FIFO_R_W
   Wire.endTransmission(false);
-  Wire.requestFrom(MPU, 2, true);
-  GyroZ = (Wire.read() << 8 | Wire.read()) / 32.8;
-  GyroZ -= GyroErrorZ;
-
-  yaw += GyroZ * elapsedTime;
-  if (yaw < 0) yaw += 360;
-  if (yaw >= 360) yaw -= 360;
-}
-
-void calculate_IMU_error() {
-  while (c < 200) {
-    Wire.beginTransmission(MPU);
-    Wire.write(0x47);
-    Wire.endTransmission(false);
-    Wire.requestFrom(MPU, 2, true);
-    GyroZ = (Wire.read() << 8 | Wire.read()) / 32.8;
-    GyroErrorZ += GyroZ;
-    c++;
-  }
-  GyroErrorZ /= 200;
-  c = 0;
+  Wire.requestFrom(imu.address, (uint8_t)(samples * 2), (uint8_t)true);
+  for (uint8_t i = 0; i < samples; i++) {
+    integrateGyro(imu, Wire.read() << 8 | Wire.read(), imuSamplePeriod);
+  }
+  imu.lastMicros = start; // the newest sample is at most one period old
+  noteI2cRead(start);
+}
+#elif defined(IMU_INT_PIN)
+void onImuDataReady() {
+  imuReadyMicros = micros();
+  imuDataReady = true;
+}
+
+void readMPU6050(Imu &imu) {
+  if (!imuDataReady) return;
+  noInterrupts();
+  unsigned long stamp = imuReadyMicros;
+  imuDataReady = false;
+  interrupts();
+
+  unsigned long dt = stamp - imu.lastMicros;
+  integrateGyro(imu, readYawRate(imu, dt), dt);
+  imu.lastMicros = stamp;
+}
+#else
+void readMPU6050(Imu &imu) {
+  // Unsigned subtraction keeps dt right across the micros() rollover
+  unsigned long now = micros();
+  unsigned long dt = now - imu.lastMicros;
+  integrateGyro(imu, readYawRate(imu, dt), dt);
+  imu.lastMicros = now;
+}
+#endif
+
+void integrateGyro(Imu &imu, int16_t raw, unsigned long dtUs) {
+  yawUpdate(imu.yaw, raw, dtUs);
+  if (imu.calibRemaining) {
+    imu.calibSum += raw;
+    if (--imu.calibRemaining == 0) {
+      imu.yaw.biasQ4 = imu.calibSum * 16 / CALIB_SAMPLES;
+      biasTrackerInit(imu.biasTracker, biasStillThreshold, imu.yaw.biasQ4);
+    }
+  } else {
+    biasTrackerUpdate(imu.biasTracker, imu.yaw, raw, dtUs);
+  }
+}
+
+// Switches once everything queued so far has gone out at the old rate
+void setHostBaud(uint32_t baud) {
+  pendingBaud = baud;
+  pendingBaudBytes = txQueue.used;
+  serialIdleUs = micros();
+}
+
+void switchBaudWhenDrained() {
+  unsigned long now = micros();
+  if (pendingBaudBytes || Serial.availableForWrite() < serialTxRoom) {
+    serialIdleUs = now;
+    return;
+  }
+  if (now - serialIdleUs < 20000000UL / hostBaud + 1) return;
+  Serial.end();
+  Serial.begin(pendingBaud);
+  hostBaud = pendingBaud;
+  pendingBaud = 0;
+  baudSwitchTime = millis();
+}
+
+bool validHostBaud(long baud) {
+  return baud == 9600 || baud == 115200 || baud == 250000 || baud == 500000 || baud == 1000000;
+}
+
+// While a BAUD switch is pending, new samples would only push its ack out of
+// a full queue, so they are dropped (and counted) instead
+void sendRecord(const uint8_t *data, size_t len, bool sample) {
+  if (pendingBaud && sample) {
+    txQueue.drops++;
+    return;
+  }
+  txQueuePush(txQueue, data, len, sample);
+}
+
+// Hands Serial only what fits in its TX buffer right now; while a BAUD
+// switch is pending, only what is left to send at the old rate
+void flushTx() {
+  const uint8_t *chunk;
+  uint16_t len;
+  int room;
+  // The drop policy may have removed some of them meanwhile
+  if (pendingBaudBytes > txQueue.used) pendingBaudBytes = txQueue.used;
+  while ((len = txQueuePeek(txQueue, chunk)) && (room = Serial.availableForWrite()) > 0) {
+    if (pendingBaud) {
+      if (!pendingBaudBytes) break;
+      if (len > pendingBaudBytes) len = pendingBaudBytes;
+    }
+    if (len > room) len = room;
+    Serial.write(chunk, len);
+    txQueueConsume(txQueue, len);
+    if (pendingBaud) pendingBaudBytes -= len;
+  }
+  if (pendingBaud) switchBaudWhenDrained();
+}
+
+// Send to Python
+void sendSample(TelemetrySample &sample) {
+  sample.seq = sampleSeq++;
+  samplesSent++;
+  if (binaryTelemetry) {
+    uint8_t frame[SAMPLE_FRAME_LEN];
+    sendRecord(frame, telemetryEncodeSample(frame, sample), true);
+  } else {
+    char line[TELEMETRY_TEXT_MAX];
+    sendRecord((const uint8_t *)line, telemetryFormatSample(line, sizeof(line), sample), true);
+  }
+}
+
+void sendStats() {
+  // LiDAR and IMU counters are summed over all units; the host can tell the
+  // units apart by the sensor ID in their samples.
+  TelemetryStats stats = {};
+  for (uint8_t i = 0; i < LIDAR_COUNT; i++) {
+    LidarUnit &unit = lidars[i];
+    stats.lidarFramesOk += unit.parser.framesOk;
+    stats.lidarChecksumErrors += unit.parser.checksumErrors;
+    stats.lidarResyncs += unit.parser.resyncs;
+    stats.lidarFrameRate += (unit.parser.framesOk - unit.framesLastInterval) * 1000 / STATS_INTERVAL_MS;
+    unit.framesLastInterval = unit.parser.framesOk;
+    stats.lidarResponses += unit.parser.responses;
+    stats.lidarWeakFrames += unit.weakFrames;
+  }
+  for (uint8_t i = 0; i < IMU_COUNT; i++) {
+    stats.imuFifoOverflows += imus[i].fifoOverflows;
+    stats.biasUpdates += imus[i].biasTracker.updates;
+  }
+  stats.lidarRxOverflows = lidarRxOverflows();
+  stats.lidarRxHighWater = lidarRxHighWater();
+  stats.samplesSent = samplesSent;
+  stats.txDrops = txQueue.drops;
+  stats.txHighWater = txQueue.highWater;
+  stats.i2cReadUsAvg = i2cReadCount ? i2cReadUsTotal / i2cReadCount : 0;
+  stats.i2cReadUsMax = i2cReadUsMax;
+  i2cReadUsTotal = 0;
+  i2cReadCount = 0;
+  i2cReadUsMax = 0;
+
+  if (binaryTelemetry) {
+    uint8_t frame[STATS_FRAME_LEN];
+    sendRecord(frame, telemetryEncodeStats(frame, stats), false);
+  } else {
+    textStats = stats;
+    textStatsField = 0;
+  }
+}
+
+void sendLoopStats() {
+  TelemetryLoopStats stats = {};
+  stats.loopsPerSecond = loopCount * 1000 / STATS_INTERVAL_MS;
+  loopCount = 0;
+#ifdef LOOP_STATS
+  stats.imu = stageTimerStats(imuStage);
+  stats.lidar = stageTimerStats(lidarStage);
+  stats.tx = stageTimerStats(txStage);
+  stats.cmd = stageTimerStats(cmdStage);
+  stageTimerReset(imuStage);
+  stageTimerReset(lidarStage);
+  stageTimerReset(txStage);
+  stageTimerReset(cmdStage);
+#endif
+  stats.imuMisses = imuTask.misses;
+  stats.imuLateMaxUs = imuTask.maxLateUs;
+  stats.lidarMisses = lidarTask.misses;
+  stats.hostMisses = hostTask.misses;
+  taskResetCounters(imuTask);
+  taskResetCounters(lidarTask);
+  taskResetCounters(hostTask);
+
+  if (binaryTelemetry) {
+    uint8_t frame[LOOP_STATS_FRAME_LEN];
+    sendRecord(frame, telemetryEncodeLoopStats(frame, stats), false);
+  } else {
+    textLoopStats = stats;
+    textLoopField = 0;
+  }
+}
+
+// Next line of a pending text stats or loop record, stats first
+void sendTextStatsLine() {
+  bool stats = textStatsField < STATS_FIELD_COUNT;
+  if (!stats && textLoopField >= LOOP_STATS_FIELD_COUNT) return;
+  if (TX_QUEUE_SIZE - txQueue.used < TELEMETRY_TEXT_MAX &&
+      millis() - textLineTime < TEXT_LINE_MAX_WAIT_MS) {
+    return;
+  }
+  char line[TELEMETRY_TEXT_MAX];
+  size_t len = stats ? telemetryFormatStats(line, sizeof(line), textStats, textStatsField)
+                     : telemetryFormatLoopStats(line, sizeof(line), textLoopStats, textLoopField);
+  sendRecord((const uint8_t *)line, len, false);
+  textLineTime = millis();
+}
+
+void pollCommands() {
+  for (uint8_t n = 0; n < COMMAND_BYTES_PER_LOOP && Serial.available(); n++) {
+    if (commandLineFeed(commandLine, Serial.read())) runCommand();
+  }
+  if (baudFallback && !pendingBaud && millis() - baudSwitchTime >= BAUD_CONFIRM_MS) {
+    setHostBaud(baudFallback);
+    baudFallback = 0;
+  }
+}
+
+// Commands from the host, answered with a type=ack text line in either
+// protocol:
+//   CALIB               re-estimate the gyro biases (sensors must be still)
+//   MODE NONE|MIN|MEDIAN|RATE   decimation mode, see aggregator.h
+//   PERIOD <ms>         AGG_RATE output period / longest bin window
+//   BIN <centideg>      yaw bin width for MIN and MEDIAN
+//   LIDAR <Hz>          TFmini Plus frame rate, all units
+//   STRENGTH <n>        minimum signal strength
+//   PROTO TEXT|BIN      telemetry protocol
+//   TXDROP OLDEST|NEWEST|COALESCE   what to drop when the TX queue is full
+//   RESET               zero the stats counters
+//   BAUD <rate>         host link rate (9600, 115200, 250000, 500000 or
+//                       1000000), confirmed by PING
+//   PING                answered with a type=hello line instead of an ack
+void runCommand() {
+  char *args = commandLineArgs(commandLine);
+  const char *cmd = commandLine.buf;
+  long value = atol(args);
+  bool ok = true;
+  char line[TELEMETRY_TEXT_MAX];
+
+  if (!strcmp_P(cmd, PSTR("PING"))) {
+    baudFallback = 0;
+    sendRecord((const uint8_t *)line,
+               telemetryFormatHello(line, sizeof(line), hostBaud, binaryTelemetry), false);
+    return;
+  }
+
+  if (!strcmp_P(cmd, PSTR("CALIB"))) {
+    for (uint8_t i = 0; i < IMU_COUNT; i++) {
+      imus[i].calibSum = 0;
+#ifdef IMU_FUSION
+      imus[i].calibSumXY[0] = 0;
+      imus[i].calibSumXY[1] = 0;
+#endif
+      imus[i].calibRemaining = CALIB_SAMPLES;
+    }
+  } else if (!strcmp_P(cmd, PSTR("MODE"))) {
+    ok = setAggregateMode(args);
+  } else if (!strcmp_P(cmd, PSTR("PERIOD"))) {
+    ok = value > 0;
+    for (uint8_t i = 0; ok && i < LIDAR_COUNT; i++) lidars[i].aggregator.periodUs = value * 1000UL;
+  } else if (!strcmp_P(cmd, PSTR("BIN"))) {
+    ok = value > 0 && value <= 36000;
+    for (uint8_t i = 0; ok && i < LIDAR_COUNT; i++) {
+      Aggregator &aggregator = lidars[i].aggregator;
+      aggregatorInit(aggregator, aggregator.mode, value, aggregator.periodUs);
+    }
+  } else if (!strcmp_P(cmd, PSTR("LIDAR"))) {
+    ok = value > 0 && value <= 1000;
+    for (uint8_t i = 0; ok && i < LIDAR_COUNT; i++) lidarConfigure(lidars[i], value);
+  } else if (!strcmp_P(cmd, PSTR("STRENGTH"))) {
+    ok = value >= 0 && value < TFMINI_STRENGTH_SATURATED;
+    if (ok) lidarMinStrength = value;
+  } else if (!strcmp_P(cmd, PSTR("PROTO"))) {
+    ok = !strcmp_P(args, PSTR("TEXT")) || !strcmp_P(args, PSTR("BIN"));
+    if (ok) binaryTelemetry = args[0] == 'B';
+  } else if (!strcmp_P(cmd, PSTR("TXDROP"))) {
+    ok = setDropPolicy(args);
+  } else if (!strcmp_P(cmd, PSTR("RESET"))) {
+    resetCounters();
+  } else if (!strcmp_P(cmd, PSTR("BAUD"))) {
+    ok = validHostBaud(value);
+  } else {
+    ok = false;
+  }
+
+  sendRecord((const uint8_t *)line, telemetryFormatAck(line, sizeof(line), cmd, ok), false);
+
+  if (ok && !strcmp_P(cmd, PSTR("BAUD")) && (uint32_t)value != hostBaud) {
+    if (!baudFallback) baudFallback = hostBaud;
+    setHostBaud(value);
+  }
+}
+
+bool setAggregateMode(const char *name) {
+  AggregateMode mode;
+  if (!strcmp_P(name, PSTR("NONE"))) mode = AGG_NONE;
+  else if (!strcmp_P(name, PSTR("MIN"))) mode = AGG_BIN_MIN;
+  else if (!strcmp_P(name, PSTR("MEDIAN"))) mode = AGG_BIN_MEDIAN;
+  else if (!strcmp_P(name, PSTR("RATE"))) mode = AGG_RATE;
+  else return false;
+  for (uint8_t i = 0; i < LIDAR_COUNT; i++) {
+    Aggregator &aggregator = lidars[i].aggregator;
+    aggregatorInit(aggregator, mode, aggregator.binCentideg, aggregator.periodUs);
+  }
+  return true;
+}
+
+bool setDropPolicy(const char *name) {
+  if (!strcmp_P(name, PSTR("OLDEST"))) txQueue.policy = TX_DROP_OLDEST;
+  else if (!strcmp_P(name, PSTR("NEWEST"))) txQueue.policy = TX_DROP_NEWEST;
+  else if (!strcmp_P(name, PSTR("COALESCE"))) txQueue.policy = TX_COALESCE;
+  else return false;
+  return true;
+}
+
+void resetCounters() {
+  for (uint8_t i = 0; i < LIDAR_COUNT; i++) {
+    LidarUnit &unit = lidars[i];
+    unit.parser.framesOk = 0;
+    unit.parser.checksumErrors = 0;
+    unit.parser.resyncs = 0;
+    unit.parser.responses = 0;
+    unit.framesLastInterval = 0;
+    unit.weakFrames = 0;
+  }
+  lidarResetRxCounters();
+  for (uint8_t i = 0; i < IMU_COUNT; i++) {
+    imus[i].fifoOverflows = 0;
+    imus[i].biasTracker.updates = 0;
+  }
+  samplesSent = 0;
+  taskResetCounters(imuTask);
+  taskResetCounters(lidarTask);
+  taskResetCounters(hostTask);
+  txQueue.drops = 0;
+  txQueue.highWater = 0;
+}
+
+void calculate_IMU_error(Imu &imu) {
+#ifdef IMU_FUSION
+  // The first gravity estimate is averaged over the same readings
+  int32_t accelSum[3] = {0, 0, 0};
+  int32_t gyroSum[3] = {0, 0, 0};
+  for (int c = 0; c < BIAS_STARTUP_SAMPLES; c++) {
+    int16_t accel[3], gyro[3];
+    readMotion(imu, accel, gyro);
+    for (uint8_t i = 0; i < 3; i++) {
+      accelSum[i] += accel[i];
+      gyroSum[i] += gyro[i];
+    }
+  }
+  int16_t accel[3];
+  for (uint8_t i = 0; i < 3; i++) accel[i] = accelSum[i] / BIAS_STARTUP_SAMPLES;
+  tiltFilterInit(imu.tilt, accel, gyroSum[0] / BIAS_STARTUP_SAMPLES, gyroSum[1] / BIAS_STARTUP_SAMPLES);
+  int32_t sum = gyroSum[2];
+#else
+  int32_t sum = 0;
+  for (int c = 0; c < BIAS_STARTUP_SAMPLES; c++) {
+    sum += readGyroZ(imu);
+  }
+#endif
+  imu.yaw.biasQ4 = sum * 16 / BIAS_STARTUP_SAMPLES;
+  biasTrackerInit(imu.biasTracker, biasStillThreshold, imu.yaw.biasQ4);
 }
@@ -0,0 +1,39 @@
+#include "scheduler.h"
+
+void taskInit(Task &task, uint32_t periodUs, uint32_t deadlineUs, uint32_t nowUs) {
+  task.periodUs = periodUs;
+  task.deadlineUs = deadlineUs;
+  task.releaseUs = nowUs;
+  taskResetCounters(task);
+}
+
+static void bookRun(Task &task, uint32_t lateUs) {
+  task.runs++;
+  if (lateUs > task.maxLateUs) task.maxLateUs = lateUs;
+  if (lateUs > task.deadlineUs) task.misses++;
+}
+
+bool taskDue(Task &task, uint32_t nowUs) {
+  // Unsigned difference, read as signed: right across the micros() rollover
+  uint32_t late = nowUs - task.releaseUs;
+  if ((int32_t)late < 0) return false;
+  bookRun(task, late);
+  task.releaseUs += task.periodUs * (1 + late / task.periodUs);
+  return true;
+}
+
+void taskRan(Task &task, uint32_t nowUs) {
+  bookRun(task, nowUs - task.releaseUs);
+  task.releaseUs = nowUs;
+}
+
+uint32_t taskSlackUs(const Task &task, uint32_t nowUs) {
+  int32_t slack = (int32_t)(task.releaseUs - nowUs);
+  return slack > 0 ? slack : 0;
+}
+
+void taskResetCounters(Task &task) {
+  task.runs = 0;
+  task.misses = 0;
+  task.maxLateUs = 0;
+}
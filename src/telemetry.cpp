@@ -0,0 +1,270 @@
+#include "telemetry.h"
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_ptr(addr) (*(const void *const *)(addr))
+#define strlen_P strlen
+#endif
+
+#include <string.h>
+
+static const char DIR_STATIONARY[] PROGMEM = "Stationary";
+static const char DIR_RIGHT[] PROGMEM = "Right";
+static const char DIR_LEFT[] PROGMEM = "Left";
+static const char OBJ_NONE[] PROGMEM = "None";
+static const char OBJ_DETECTED[] PROGMEM = "Detected";
+static const char GYRO_STILL[] PROGMEM = "Still";
+static const char GYRO_MOVING[] PROGMEM = "Moving";
+
+static const char KEY_DISTANCE[] PROGMEM = "distance=";
+static const char KEY_YAW[] PROGMEM = ",yaw=";
+static const char KEY_DIRECTION[] PROGMEM = ",direction=";
+static const char KEY_OBJECT[] PROGMEM = ",object=";
+static const char KEY_GYRO[] PROGMEM = ",gyro=";
+static const char KEY_TIMESTAMP[] PROGMEM = ",t_us=";
+static const char KEY_STRENGTH[] PROGMEM = ",strength=";
+static const char KEY_TEMPERATURE[] PROGMEM = ",temp=";
+static const char KEY_SENSOR[] PROGMEM = ",sensor=";
+static const char KEY_STATS[] PROGMEM = "type=stats";
+static const char KEY_LOOP[] PROGMEM = "type=loop";
+static const char KEY_ACK[] PROGMEM = "type=ack,cmd=";
+static const char KEY_OK[] PROGMEM = ",ok=";
+static const char KEY_HELLO[] PROGMEM = "type=hello,baud=";
+static const char KEY_PROTO[] PROGMEM = ",proto=";
+static const char PROTO_TEXT[] PROGMEM = "text";
+static const char PROTO_BINARY[] PROGMEM = "bin";
+
+// Same order as TelemetryStats and STATS_FIELDS in python/telemetry.py
+static const char STAT_FRAMES_OK[] PROGMEM = "frames_ok";
+static const char STAT_CHECKSUM_ERRORS[] PROGMEM = "checksum_errors";
+static const char STAT_RESYNCS[] PROGMEM = "resyncs";
+static const char STAT_RX_OVERFLOWS[] PROGMEM = "rx_overflows";
+static const char STAT_RX_HIGH_WATER[] PROGMEM = "rx_high_water";
+static const char STAT_IMU_FIFO_OVERFLOWS[] PROGMEM = "imu_fifo_overflows";
+static const char STAT_I2C_US_AVG[] PROGMEM = "i2c_us_avg";
+static const char STAT_I2C_US_MAX[] PROGMEM = "i2c_us_max";
+static const char STAT_SAMPLES_SENT[] PROGMEM = "samples_sent";
+static const char STAT_LIDAR_HZ[] PROGMEM = "lidar_hz";
+static const char STAT_LIDAR_RESPONSES[] PROGMEM = "lidar_responses";
+static const char STAT_WEAK_FRAMES[] PROGMEM = "weak_frames";
+static const char STAT_BIAS_UPDATES[] PROGMEM = "bias_updates";
+static const char STAT_TX_DROPS[] PROGMEM = "tx_drops";
+static const char STAT_TX_HIGH_WATER[] PROGMEM = "tx_high_water";
+
+static const char *const STAT_NAMES[] PROGMEM = {
+  STAT_FRAMES_OK, STAT_CHECKSUM_ERRORS, STAT_RESYNCS, STAT_RX_OVERFLOWS,
+  STAT_RX_HIGH_WATER, STAT_IMU_FIFO_OVERFLOWS, STAT_I2C_US_AVG, STAT_I2C_US_MAX,
+  STAT_SAMPLES_SENT, STAT_LIDAR_HZ, STAT_LIDAR_RESPONSES,
+  STAT_WEAK_FRAMES, STAT_BIAS_UPDATES, STAT_TX_DROPS, STAT_TX_HIGH_WATER,
+};
+// Same order as TelemetryLoopStats and LOOP_FIELDS in python/telemetry.py
+static const char LOOP_LOOPS[] PROGMEM = "loops_per_s";
+static const char LOOP_IMU_MIN[] PROGMEM = "imu_min";
+static const char LOOP_IMU_AVG[] PROGMEM = "imu_avg";
+static const char LOOP_IMU_MAX[] PROGMEM = "imu_max";
+static const char LOOP_LIDAR_MIN[] PROGMEM = "lidar_min";
+static const char LOOP_LIDAR_AVG[] PROGMEM = "lidar_avg";
+static const char LOOP_LIDAR_MAX[] PROGMEM = "lidar_max";
+static const char LOOP_TX_MIN[] PROGMEM = "tx_min";
+static const char LOOP_TX_AVG[] PROGMEM = "tx_avg";
+static const char LOOP_TX_MAX[] PROGMEM = "tx_max";
+static const char LOOP_CMD_MIN[] PROGMEM = "cmd_min";
+static const char LOOP_CMD_AVG[] PROGMEM = "cmd_avg";
+static const char LOOP_CMD_MAX[] PROGMEM = "cmd_max";
+static const char LOOP_IMU_MISSES[] PROGMEM = "imu_misses";
+static const char LOOP_IMU_LATE_MAX[] PROGMEM = "imu_late_max";
+static const char LOOP_LIDAR_MISSES[] PROGMEM = "lidar_misses";
+static const char LOOP_HOST_MISSES[] PROGMEM = "host_misses";
+
+static const char *const LOOP_NAMES[] PROGMEM = {
+  LOOP_LOOPS,
+  LOOP_IMU_MIN, LOOP_IMU_AVG, LOOP_IMU_MAX,
+  LOOP_LIDAR_MIN, LOOP_LIDAR_AVG, LOOP_LIDAR_MAX,
+  LOOP_TX_MIN, LOOP_TX_AVG, LOOP_TX_MAX,
+  LOOP_CMD_MIN, LOOP_CMD_AVG, LOOP_CMD_MAX,
+  LOOP_IMU_MISSES, LOOP_IMU_LATE_MAX, LOOP_LIDAR_MISSES, LOOP_HOST_MISSES,
+};
+static_assert(sizeof(LOOP_NAMES) / sizeof(LOOP_NAMES[0]) == LOOP_STATS_FIELD_COUNT,
+              "every TelemetryLoopStats field needs a text name");
+
+static_assert(sizeof(STAT_NAMES) / sizeof(STAT_NAMES[0]) == STATS_FIELD_COUNT,
+              "every TelemetryStats counter needs a text name");
+
+uint16_t crc16Update(uint16_t crc, uint8_t data) {
+  crc ^= (uint16_t)data << 8;
+  for (uint8_t i = 0; i < 8; i++) {
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t v) {
+  p[0] = v & 0xff;
+  p[1] = v >> 8;
+  return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v) {
+  p = put16(p, v & 0xffff);
+  return put16(p, v >> 16);
+}
+
+// Fills in sync, type and len around an already written payload and
+// appends the CRC.
+static size_t finishFrame(uint8_t *buf, uint8_t type, uint8_t len) {
+  buf[0] = TELEMETRY_SYNC0;
+  buf[1] = TELEMETRY_SYNC1;
+  buf[2] = type;
+  buf[3] = len;
+  uint16_t crc = 0xFFFF;
+  for (uint8_t i = 2; i < len + 4; i++) crc = crc16Update(crc, buf[i]);
+  put16(buf + len + 4, crc);
+  return len + TELEMETRY_OVERHEAD;
+}
+
+size_t telemetryEncodeSample(uint8_t *buf, const TelemetrySample &sample) {
+  uint8_t *p = buf + 4;
+  p = put16(p, sample.seq);
+  p = put32(p, sample.timestampUs);
+  p = put16(p, sample.distance);
+  p = put16(p, sample.yawCentideg);
+  *p++ = (sample.status & ~STATUS_SENSOR_MASK) | (sample.sensor << STATUS_SENSOR_SHIFT & STATUS_SENSOR_MASK);
+  p = put16(p, sample.strength);
+  put16(p, sample.temperatureDeci);
+  return finishFrame(buf, FRAME_SAMPLE, SAMPLE_PAYLOAD_LEN);
+}
+
+static size_t encodeCounters(uint8_t *buf, uint8_t type, const uint32_t *counters, uint8_t count) {
+  uint8_t *p = buf + 4;
+  for (uint8_t i = 0; i < count; i++) p = put32(p, counters[i]);
+  return finishFrame(buf, type, count * 4);
+}
+
+size_t telemetryEncodeStats(uint8_t *buf, const TelemetryStats &stats) {
+  return encodeCounters(buf, FRAME_STATS, (const uint32_t *)&stats, STATS_PAYLOAD_LEN / 4);
+}
+
+size_t telemetryEncodeLoopStats(uint8_t *buf, const TelemetryLoopStats &stats) {
+  return encodeCounters(buf, FRAME_LOOP_STATS, (const uint32_t *)&stats, LOOP_STATS_PAYLOAD_LEN / 4);
+}
+
+// Bounded writer for the text format. Output past the end is cut off, but
+// two bytes stay reserved so a truncated line still ends in CR LF.
+struct TextOut {
+  char *p;
+  char *end;
+};
+
+static TextOut textOut(char *buf, size_t size) {
+  TextOut out = {buf, buf + size - 2};
+  return out;
+}
+
+static void putChar(TextOut &out, char c) {
+  if (out.p < out.end) *out.p++ = c;
+}
+
+static void putFlash(TextOut &out, const char *text) {
+  char c;
+  while ((c = pgm_read_byte(text++))) putChar(out, c);
+}
+
+static void putUint(TextOut &out, uint32_t value) {
+  char digits[10];
+  uint8_t n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (n) putChar(out, digits[--n]);
+}
+
+static size_t finishLine(TextOut &out, char *buf) {
+  *out.p++ = '\r';
+  *out.p++ = '\n';
+  return out.p - buf;
+}
+
+size_t telemetryFormatSample(char *buf, size_t size, const TelemetrySample &sample) {
+  TextOut out = textOut(buf, size);
+  putFlash(out, KEY_DISTANCE);
+  putUint(out, sample.distance);
+  putFlash(out, KEY_YAW);
+  putUint(out, sample.yawCentideg / 100);
+  putChar(out, '.');
+  uint8_t hundredths = sample.yawCentideg % 100;
+  putChar(out, '0' + hundredths / 10);
+  putChar(out, '0' + hundredths % 10);
+  putFlash(out, KEY_DIRECTION);
+  if (sample.status & STATUS_DIR_RIGHT) putFlash(out, DIR_RIGHT);
+  else if (sample.status & STATUS_DIR_LEFT) putFlash(out, DIR_LEFT);
+  else putFlash(out, DIR_STATIONARY);
+  putFlash(out, KEY_OBJECT);
+  putFlash(out, (sample.status & STATUS_OBJECT) ? OBJ_DETECTED : OBJ_NONE);
+  putFlash(out, KEY_GYRO);
+  putFlash(out, (sample.status & STATUS_MOVING) ? GYRO_MOVING : GYRO_STILL);
+  putFlash(out, KEY_TIMESTAMP);
+  putUint(out, sample.timestampUs);
+  putFlash(out, KEY_STRENGTH);
+  putUint(out, sample.strength);
+  putFlash(out, KEY_TEMPERATURE);
+  int16_t temp = sample.temperatureDeci;
+  if (temp < 0) {
+    putChar(out, '-');
+    temp = -temp;
+  }
+  putUint(out, temp / 10);
+  putChar(out, '.');
+  putChar(out, '0' + temp % 10);
+  putFlash(out, KEY_SENSOR);
+  putUint(out, sample.sensor);
+  return finishLine(out, buf);
+}
+
+static size_t formatCounters(char *buf, size_t size, const char *prefix, const char *const *names,
+                             const uint32_t *counters, uint8_t count, uint8_t &field) {
+  TextOut out = textOut(buf, size);
+  putFlash(out, prefix);
+  for (; field < count; field++) {
+    // Whole fields only: ',' name '=' and up to ten digits
+    const char *name = (const char *)pgm_read_ptr(&names[field]);
+    if (out.end - out.p < (ptrdiff_t)strlen_P(name) + 12) break;
+    putChar(out, ',');
+    putFlash(out, name);
+    putChar(out, '=');
+    putUint(out, counters[field]);
+  }
+  return finishLine(out, buf);
+}
+
+size_t telemetryFormatStats(char *buf, size_t size, const TelemetryStats &stats, uint8_t &field) {
+  return formatCounters(buf, size, KEY_STATS, STAT_NAMES, (const uint32_t *)&stats,
+                        STATS_FIELD_COUNT, field);
+}
+
+size_t telemetryFormatLoopStats(char *buf, size_t size, const TelemetryLoopStats &stats,
+                                uint8_t &field) {
+  return formatCounters(buf, size, KEY_LOOP, LOOP_NAMES, (const uint32_t *)&stats,
+                        LOOP_STATS_FIELD_COUNT, field);
+}
+
+size_t telemetryFormatAck(char *buf, size_t size, const char *command, bool ok) {
+  TextOut out = textOut(buf, size);
+  putFlash(out, KEY_ACK);
+  while (*command) putChar(out, *command++);
+  putFlash(out, KEY_OK);
+  putChar(out, ok ? '1' : '0');
+  return finishLine(out, buf);
+}
+
+size_t telemetryFormatHello(char *buf, size_t size, uint32_t baud, bool binary) {
+  TextOut out = textOut(buf, size);
+  putFlash(out, KEY_HELLO);
+  putUint(out, baud);
+  putFlash(out, KEY_PROTO);
+  putFlash(out, binary ? PROTO_BINARY : PROTO_TEXT);
+  return finishLine(out, buf);
+}
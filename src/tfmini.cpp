@@ -0,0 +1,86 @@
+#include "tfmini.h"
+
+#include <string.h>
+
+void tfminiReset(TFminiParser &parser) {
+  memset(&parser, 0, sizeof(parser));
+}
+
+static void lostSync(TFminiParser &parser) {
+  if (parser.synced) parser.resyncs++;
+  parser.synced = false;
+}
+
+// Moves the earliest possible header in frame[1..8] to the front, keeping the
+// bytes after it as the start of the next frame.
+static void rescan(TFminiParser &parser) {
+  uint8_t i = 1;
+  for (; i < TFMINI_FRAME_LEN; i++) {
+    if (parser.frame[i] != TFMINI_HEADER) continue;
+    if (i == TFMINI_FRAME_LEN - 1 || parser.frame[i + 1] == TFMINI_HEADER) break;
+  }
+  parser.pos = TFMINI_FRAME_LEN - i;
+  memmove(parser.frame, parser.frame + i, parser.pos);
+}
+
+bool tfminiFeed(TFminiParser &parser, uint8_t data) {
+  if (parser.skip) {
+    if (parser.skip == 0xff) {
+      // Length byte of a response; anything implausible was not one
+      parser.skip = (data >= 4 && data <= TFMINI_CMD_MAX) ? data - 2 : 0;
+      if (parser.skip) parser.responses++;
+    } else {
+      parser.skip--;
+    }
+    return false;
+  }
+
+  if (parser.pos == 0 && data == TFMINI_CMD_HEADER) {
+    parser.skip = 0xff;
+    return false;
+  }
+
+  if (parser.pos < 2) {
+    if (data == TFMINI_HEADER) {
+      parser.frame[parser.pos++] = data;
+    } else {
+      parser.pos = 0;
+      lostSync(parser);
+    }
+    return false;
+  }
+
+  parser.frame[parser.pos++] = data;
+  if (parser.pos < TFMINI_FRAME_LEN) return false;
+
+  uint8_t check = 0;
+  for (uint8_t i = 0; i < TFMINI_FRAME_LEN - 1; i++) check += parser.frame[i];
+  if (check == parser.frame[TFMINI_FRAME_LEN - 1]) {
+    parser.pos = 0;
+    parser.synced = true;
+    parser.framesOk++;
+    return true;
+  }
+
+  parser.checksumErrors++;
+  lostSync(parser);
+  rescan(parser);
+  return false;
+}
+
+uint8_t tfminiCommand(uint8_t *buf, uint8_t id, const uint8_t *payload, uint8_t len) {
+  uint8_t total = len + 4;
+  buf[0] = TFMINI_CMD_HEADER;
+  buf[1] = total;
+  buf[2] = id;
+  memcpy(buf + 3, payload, len);
+  uint8_t check = 0;
+  for (uint8_t i = 0; i < total - 1; i++) check += buf[i];
+  buf[total - 1] = check;
+  return total;
+}
+
+uint8_t tfminiFrameRateCommand(uint8_t *buf, uint16_t hz) {
+  uint8_t payload[2] = {(uint8_t)(hz & 0xff), (uint8_t)(hz >> 8)};
+  return tfminiCommand(buf, TFMINI_ID_FRAME_RATE, payload, sizeof(payload));
+}
@@ -0,0 +1,75 @@
+#include "tilt.h"
+
+// Q16 radians per gyro LSB and 16 µs: 1 / 32.8 * pi / 180 * 16e-6 * 65536,
+// or 9361 / 2^24, applied as >> 9, * 9361, >> 15.
+static const int32_t RAD_Q16_PER_LSB_16US = 9361;
+
+static const int32_t UP_MAX = 32767; // keeps the squared length in a uint32
+
+static int32_t clampUp(int32_t v) {
+  return v > UP_MAX ? UP_MAX : (v < -UP_MAX ? -UP_MAX : v);
+}
+
+static uint16_t isqrt32(uint32_t n) {
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+  while (bit > n) bit >>= 2;
+  while (bit) {
+    if (n >= root + bit) {
+      n -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+// Rounded (a * b) >> 16 for a rotation angle in Q16 and an up component
+static int32_t mulQ16(int32_t a, int32_t b) {
+  return (a * b + 0x8000) >> 16;
+}
+
+void tiltFilterInit(TiltFilter &filter, const int16_t accel[3], int16_t biasX, int16_t biasY) {
+  for (uint8_t i = 0; i < 3; i++) filter.up[i] = clampUp((int32_t)accel[i] * 4);
+  filter.gyroBias[0] = biasX;
+  filter.gyroBias[1] = biasY;
+}
+
+int16_t tiltFilterUpdate(TiltFilter &filter, const int16_t accel[3], const int16_t gyro[3],
+                         int16_t biasZ, uint32_t dtUs) {
+  int32_t rate[3] = {
+    (int32_t)gyro[0] - filter.gyroBias[0],
+    (int32_t)gyro[1] - filter.gyroBias[1],
+    (int32_t)gyro[2] - biasZ,
+  };
+
+  // Rotation over dt: rate * dt/16 is below 2^26, and shifting it by 9
+  // before the multiply keeps the product in an int32
+  int32_t dt16 = (dtUs > TILT_MAX_DT_US ? TILT_MAX_DT_US : dtUs) >> 4;
+  int32_t angle[3];
+  for (uint8_t i = 0; i < 3; i++) {
+    angle[i] = ((rate[i] * dt16) >> 9) * RAD_Q16_PER_LSB_16US >> 15;
+  }
+
+  // Gravity is fixed in the world, so in the sensor frame it turns the other
+  // way: up -= angle x up
+  int32_t *up = filter.up;
+  int32_t x = up[0] - (mulQ16(angle[1], up[2]) - mulQ16(angle[2], up[1]));
+  int32_t y = up[1] - (mulQ16(angle[2], up[0]) - mulQ16(angle[0], up[2]));
+  int32_t z = up[2] - (mulQ16(angle[0], up[1]) - mulQ16(angle[1], up[0]));
+  up[0] = clampUp(x + (((int32_t)accel[0] * 4 - x) >> TILT_SHIFT));
+  up[1] = clampUp(y + (((int32_t)accel[1] * 4 - y) >> TILT_SHIFT));
+  up[2] = clampUp(z + (((int32_t)accel[2] * 4 - z) >> TILT_SHIFT));
+
+  // Turn rate about the vertical is rate . up / |up|; only its difference
+  // from the Z axis rate is added, so a level sensor gives back raw exactly
+  int32_t ux = up[0] >> 2, uy = up[1] >> 2, uz = up[2] >> 2;
+  int32_t length = isqrt32((uint32_t)(ux * ux) + (uint32_t)(uy * uy) + (uint32_t)(uz * uz));
+  if (length == 0) return gyro[2];
+  int32_t correction = (rate[0] * ux + rate[1] * uy + rate[2] * (uz - length)) / length;
+
+  int32_t out = gyro[2] + correction;
+  return out > 32767 ? 32767 : (out < -32768 ? -32768 : out);
+}
@@ -0,0 +1,101 @@
+#include "tx_queue.h"
+
+static uint16_t wrap(uint16_t i) {
+  return i < TX_QUEUE_SIZE ? i : i - TX_QUEUE_SIZE;
+}
+
+static uint8_t recordIndex(const TxQueue &q, uint8_t n) {
+  uint8_t i = q.first + n;
+  return i < TX_QUEUE_RECORDS ? i : i - TX_QUEUE_RECORDS;
+}
+
+void txQueueInit(TxQueue &q, TxDropPolicy policy) {
+  q.policy = policy;
+  q.head = 0;
+  q.used = 0;
+  q.headSent = 0;
+  q.first = 0;
+  q.count = 0;
+  q.drops = 0;
+  q.highWater = 0;
+}
+
+// Record the policy drops to make room for a new one, or -1 to drop the new
+// one instead
+static int8_t pickVictim(const TxQueue &q, bool sample) {
+  uint8_t n = q.headSent ? 1 : 0;
+  if (q.policy == TX_DROP_NEWEST && sample) return -1;
+  if (q.policy == TX_DROP_OLDEST) return n < q.count ? n : -1;
+  for (; n < q.count; n++) {
+    if (q.records[recordIndex(q, n)].sample) return n;
+  }
+  return -1;
+}
+
+// Removes the nth queued record (not yet started) by moving the records
+// ahead of it up over its bytes. Only happens when the queue is full.
+static void removeRecord(TxQueue &q, uint8_t n) {
+  uint16_t offset = 0;
+  for (uint8_t i = 0; i < n; i++) offset += q.records[recordIndex(q, i)].len;
+  offset -= q.headSent;
+  uint8_t len = q.records[recordIndex(q, n)].len;
+
+  while (offset--) q.data[wrap(q.head + offset + len)] = q.data[wrap(q.head + offset)];
+  q.head = wrap(q.head + len);
+  q.used -= len;
+
+  for (; n > 0; n--) q.records[recordIndex(q, n)] = q.records[recordIndex(q, n - 1)];
+  q.first = recordIndex(q, 1);
+  q.count--;
+}
+
+bool txQueuePush(TxQueue &q, const uint8_t *data, uint8_t len, bool sample) {
+  uint16_t size = len;
+  if (size > TX_QUEUE_SIZE) {
+    q.drops++;
+    return false;
+  }
+  while (size > TX_QUEUE_SIZE - q.used || q.count == TX_QUEUE_RECORDS) {
+    int8_t victim = pickVictim(q, sample);
+    q.drops++;
+    if (victim < 0) return false;
+    removeRecord(q, victim);
+  }
+
+  uint16_t tail = wrap(q.head + q.used);
+  for (uint8_t i = 0; i < len; i++) {
+    q.data[tail] = data[i];
+    tail = wrap(tail + 1);
+  }
+  q.used += len;
+  if (q.used > q.highWater) q.highWater = q.used;
+
+  TxRecord &record = q.records[recordIndex(q, q.count)];
+  record.len = len;
+  record.sample = sample;
+  q.count++;
+  return true;
+}
+
+uint16_t txQueuePeek(const TxQueue &q, const uint8_t *&data) {
+  data = q.data + q.head;
+  uint16_t contiguous = TX_QUEUE_SIZE - q.head;
+  return q.used < contiguous ? q.used : contiguous;
+}
+
+void txQueueConsume(TxQueue &q, uint16_t sent) {
+  if (sent > q.used) sent = q.used;
+  q.head = wrap(q.head + sent);
+  q.used -= sent;
+  while (sent && q.count) {
+    uint8_t rest = q.records[q.first].len - q.headSent;
+    if (sent < rest) {
+      q.headSent += sent;
+      return;
+    }
+    sent -= rest;
+    q.headSent = 0;
+    q.first = recordIndex(q, 1);
+    q.count--;
+  }
+}
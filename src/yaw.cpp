@@ -0,0 +1,58 @@
+#include "yaw.h"
+
+#include <string.h>
+
+void yawReset(YawIntegrator &yaw) {
+  memset(&yaw, 0, sizeof(yaw));
+}
+
+void yawUpdate(YawIntegrator &yaw, int16_t raw, uint32_t dtUs) {
+  uint16_t dt = dtUs > YAW_MAX_DT_US ? YAW_MAX_DT_US : dtUs;
+  int32_t rate = ((int32_t)raw << 4) - yaw.biasQ4;
+  yaw.rateQ4 = rate;
+
+  // rate * dt = rate * (dt >> 8) angle units + rate * (dt & 0xff) / 256
+  int32_t step = rate * (dt >> 8);
+  yaw.residual += rate * (dt & 0xff);
+  step += yaw.residual >> 8;
+  yaw.residual &= 0xff;
+
+  yaw.angle += step;
+  if (yaw.angle < 0) yaw.angle += YAW_UNITS_PER_TURN;
+  else if (yaw.angle >= YAW_UNITS_PER_TURN) yaw.angle -= YAW_UNITS_PER_TURN;
+}
+
+uint16_t yawCentidegAt(const YawIntegrator &yaw, int32_t offsetUs) {
+  int32_t rate = yaw.rateQ4;
+  if (offsetUs < 0) {
+    rate = -rate;
+    offsetUs = -offsetUs;
+  }
+  uint16_t dt = offsetUs > YAW_MAX_DT_US ? YAW_MAX_DT_US : offsetUs;
+  int32_t angle = yaw.angle + rate * (dt >> 8) + ((yaw.residual + rate * (dt & 0xff)) >> 8);
+  if (angle < 0) angle += YAW_UNITS_PER_TURN;
+  else if (angle >= YAW_UNITS_PER_TURN) angle -= YAW_UNITS_PER_TURN;
+  return yawAngleCentideg(angle);
+}
+
+void biasTrackerInit(BiasTracker &tracker, int32_t stillThresholdQ4, int32_t biasQ4) {
+  tracker.stillThresholdQ4 = stillThresholdQ4;
+  tracker.biasQ12 = biasQ4 << 8;
+  tracker.rateQ4 = 0;
+  tracker.stillUs = 0;
+}
+
+void biasTrackerUpdate(BiasTracker &tracker, YawIntegrator &yaw, int16_t raw, uint32_t dtUs) {
+  tracker.rateQ4 += (yaw.rateQ4 - tracker.rateQ4) >> 4;
+  if (tracker.rateQ4 > tracker.stillThresholdQ4 || tracker.rateQ4 < -tracker.stillThresholdQ4) {
+    tracker.stillUs = 0;
+    return;
+  }
+  if (tracker.stillUs < BIAS_SETTLE_US) {
+    tracker.stillUs += dtUs;
+    return;
+  }
+  tracker.biasQ12 += (((int32_t)raw << 12) - tracker.biasQ12) >> BIAS_SHIFT;
+  yaw.biasQ4 = tracker.biasQ12 >> 8;
+  tracker.updates++;
+}